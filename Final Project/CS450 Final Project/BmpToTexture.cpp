@@ -8,13 +8,23 @@
 
 #include "BmpToTexture.hpp"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
 struct bmfh {
     short bfType;
     int bfSize;
     short bfReserved1;
     short bfReserved2;
     int bfOffBits;
-} FileHeader;
+};
 
 struct bmih {
     int biSize;
@@ -28,115 +38,649 @@ struct bmih {
     int biYPelsPerMeter;
     int biClrUsed;
     int biClrImportant;
-} InfoHeader;
+};
 
 const int birgb = { 0 };
+const int bibitfields = { 3 };
+const int bialphabitfields = { 6 };
+
+// largest header we ever need in memory: file + V5 info header + a full palette
+#define BMP_MAX_HEADER  (14 + 124 + 256*4)
+
+// one channel of a BITFIELDS pixel:
+struct bmpchannel {
+    int shift;                  // lowest bit of the field (after trimming it to 8 bits)
+    int bits;                   // width of the field, at most 8 (0 if absent)
+};
+
+// everything the decoders need to know about an image:
+struct bmpformat {
+    int width, height;          // height is always positive
+    bool topdown;               // rows are stored top row first
+    int bits;                   // bits per pixel
+    int compression;
+    int rowbytes;               // bytes per row in the file, padded to 4
+    int offset;                 // bfOffBits: where the pixel array starts
+    int ncomps;                 // components decoded to: 3 (RGB) or 4 (RGBA)
+    bool bgra;                  // 32 bit B,G,R,A bytes (the A unused when ncomps is 3), which a plain swizzle handles
+    struct bmpchannel channels[4];  // r, g, b, a for 16 bit and BITFIELDS images
+    unsigned int palette[256];  // RGBX words for 8 bit images
+};
+
+
+
+
+bool BmpQuiet = false;
+
+// little-endian fields out of a header that has already been read into memory:
+int GetInt(unsigned char *p) {
+    return (int)(((unsigned int)p[3] << 24)  |  (p[2] << 16)  |  (p[1] << 8)  |  p[0]);
+}
+
+short GetShort(unsigned char *p) {
+    return (p[1] << 8)  |  p[0];
+}
+
+/**
+ ** swap BGR triples to RGB while packing a row down to dst
+ ** (dst may be the same row or start before src, as when dropping padding in place)
+ **/
+void SwizzleBgrRow(unsigned char *dst, unsigned char *src, int numbytes) {
+    int i = 0;
+
+#ifdef __SSSE3__
+    // five pixels per 16 byte load; the 16th byte is passed through unchanged so
+    // the overlapping store never clobbers a byte that has not been read yet
+    const __m128i mask = _mm_setr_epi8(2, 1, 0,  5, 4, 3,  8, 7, 6,  11, 10, 9,  14, 13, 12,  15);
+    for (; i + 16 <= numbytes; i += 15) {
+        __m128i v = _mm_loadu_si128((__m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_shuffle_epi8(v, mask));
+    }
+#endif
+
+    for (; i + 3 <= numbytes; i += 3) {
+        unsigned char b = src[i];
+        unsigned char g = src[i+1];
+        unsigned char r = src[i+2];
+        dst[i+0] = r;
+        dst[i+1] = g;
+        dst[i+2] = b;
+    }
+}
+
+/**
+ ** reorder 4 byte pixels: output byte c of each pixel is input byte order[c],
+ ** for outcomps (3 or 4) bytes per output pixel
+ ** (dst may be the same buffer or start before src, so BGRA->RGB packs down in place)
+ **/
+void ShuffleQuadRow(unsigned char *dst, unsigned char *src, int numpixels, const int order[4], int outcomps) {
+    int i = 0;
+
+#ifdef __SSSE3__
+    // four pixels per 16 byte load; a 3 component store is 12 bytes wide plus 4 that
+    // land where the next store starts, which is never ahead of the next load
+    unsigned char lanes[16];
+    for (int p = 0; p < 4; p++)
+        for (int c = 0; c < 4; c++)
+            if (c < outcomps) lanes[p*outcomps + c] = 4*p + order[c];
+    for (int b = 4*outcomps; b < 16; b++) lanes[b] = 0x80;
+    const __m128i mask = _mm_loadu_si128((__m128i*)lanes);
+
+    for (; i + 4 <= numpixels; i += 4) {
+        __m128i v = _mm_loadu_si128((__m128i*)(src + 4*i));
+        __m128i s = _mm_shuffle_epi8(v, mask);
+        if (outcomps == 4 || i + 8 <= numpixels)
+            _mm_storeu_si128((__m128i*)(dst + outcomps*i), s);
+        else
+            break;      // last group of a 3 component row: do not write past the end
+    }
+#endif
+
+    for (; i < numpixels; i++) {
+        unsigned char px[4] = { src[4*i], src[4*i+1], src[4*i+2], src[4*i+3] };
+        for (int c = 0; c < outcomps; c++)
+            dst[outcomps*i + c] = px[order[c]];
+    }
+}
+
+/**
+ ** look 8 bit indices up in an RGBX palette and write RGB triples:
+ **/
+void ExpandPaletteRow(unsigned char *dst, unsigned char *src, const unsigned int *palette, int numpixels) {
+    int i = 0;
+
+#ifdef __AVX2__
+    // gather eight palette words, then drop every fourth byte within each lane;
+    // the two 12 byte halves go out as 16 byte stores, so stay 4 bytes clear of the end
+    const __m256i pack = _mm256_setr_epi8(0, 1, 2,  4, 5, 6,  8, 9, 10,  12, 13, 14,  -1, -1, -1, -1,
+                                          0, 1, 2,  4, 5, 6,  8, 9, 10,  12, 13, 14,  -1, -1, -1, -1);
+    for (; i + 10 <= numpixels; i += 8) {
+        __m256i idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i*)(src + i)));
+        __m256i rgbx = _mm256_i32gather_epi32((const int*)palette, idx, 4);
+        __m256i rgb = _mm256_shuffle_epi8(rgbx, pack);
+        _mm_storeu_si128((__m128i*)(dst + 3*i), _mm256_castsi256_si128(rgb));
+        _mm_storeu_si128((__m128i*)(dst + 3*i + 12), _mm256_extracti128_si256(rgb, 1));
+    }
+#endif
+
+    // one 4 byte store per pixel, each overwriting the spare byte of the one before
+    for (; i + 1 < numpixels; i++)
+        memcpy(dst + 3*i, &palette[src[i]], 4);
+    for (; i < numpixels; i++)
+        memcpy(dst + 3*i, &palette[src[i]], 3);
+}
+
+/**
+ ** widen a field of 'bits' bits (already shifted down) to 8 bits by repeating its
+ ** top bits, so all-ones stays all-ones (0x1f -> 0xff, 0x1 -> 0xff)
+ **/
+unsigned int ExpandField(unsigned int v, int bits) {
+    v <<= 8 - bits;
+    for (int filled = bits; filled < 8; filled *= 2)
+        v |= v >> filled;
+    return v;
+}
+
+/**
+ ** unpack 16 or 32 bit masked pixels into RGBA:
+ **/
+void UnpackBitfieldsRow(unsigned char *dst, unsigned char *src, int numpixels, int bits, const struct bmpchannel channels[4]) {
+    int i = 0;
+
+#ifdef __SSE2__
+    // four pixels at a time: the shift counts are the same for every lane of a channel
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 4 <= numpixels; i += 4) {
+        __m128i px;
+        if (bits == 16)
+            px = _mm_unpacklo_epi16(_mm_loadl_epi64((__m128i*)(src + 2*i)), zero);
+        else
+            px = _mm_loadu_si128((__m128i*)(src + 4*i));
+
+        __m128i out = zero;
+        for (int c = 0; c < 4; c++) {
+            const struct bmpchannel &ch = channels[c];
+            __m128i v;
+            if (ch.bits == 0) {
+                v = _mm_set1_epi32(c == 3 ? 0xff : 0);     // no alpha field means opaque
+            } else {
+                v = _mm_and_si128(_mm_srl_epi32(px, _mm_cvtsi32_si128(ch.shift)), _mm_set1_epi32((1 << ch.bits) - 1));
+                v = _mm_sll_epi32(v, _mm_cvtsi32_si128(8 - ch.bits));
+                for (int filled = ch.bits; filled < 8; filled *= 2)
+                    v = _mm_or_si128(v, _mm_srl_epi32(v, _mm_cvtsi32_si128(filled)));
+            }
+            out = _mm_or_si128(out, _mm_sll_epi32(v, _mm_cvtsi32_si128(8*c)));
+        }
+        _mm_storeu_si128((__m128i*)(dst + 4*i), out);
+    }
+#endif
+
+    for (; i < numpixels; i++) {
+        unsigned int px;
+        if (bits == 16)
+            px = (unsigned short)GetShort(src + 2*i);
+        else
+            px = (unsigned int)GetInt(src + 4*i);
+
+        for (int c = 0; c < 4; c++) {
+            const struct bmpchannel &ch = channels[c];
+            if (ch.bits == 0)
+                dst[4*i + c] = (c == 3 ? 0xff : 0);
+            else
+                dst[4*i + c] = ExpandField((px >> ch.shift) & ((1u << ch.bits) - 1), ch.bits);
+        }
+    }
+}
+
+// turn a top-down image the right way up for GL (bottom row first):
+void FlipRows(unsigned char *pixels, int rowbytes, int numrows) {
+    unsigned char *tmp = new unsigned char[rowbytes];
+    for (int t = 0; t < numrows / 2; t++) {
+        unsigned char *a = pixels + (size_t)t * rowbytes;
+        unsigned char *b = pixels + (size_t)(numrows - 1 - t) * rowbytes;
+        memcpy(tmp, a, rowbytes);
+        memcpy(a, b, rowbytes);
+        memcpy(b, tmp, rowbytes);
+    }
+    delete [] tmp;
+}
+
+// a BITFIELDS mask as a shift and width (false if its bits are not contiguous):
+bool ParseMask(unsigned int mask, struct bmpchannel &ch) {
+    ch.shift = 0;
+    ch.bits = 0;
+    if (mask == 0) return true;
+
+    while ((mask & 1) == 0) { mask >>= 1; ch.shift++; }
+    while (mask & 1) { mask >>= 1; ch.bits++; }
+    if (mask != 0) return false;
+
+    // only the top 8 bits of a wide field survive anyway
+    if (ch.bits > 8) {
+        ch.shift += ch.bits - 8;
+        ch.bits = 8;
+    }
+    return true;
+}
+
+// why a header was turned down (unless BmpQuiet):
+void bmpError(const char *format, ...) {
+    if (BmpQuiet) return;
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+/**
+ ** decode the file and info headers, palette and masks (the first 'length' bytes
+ ** of a 'filesize' byte file) and check we can handle the image; every size is
+ ** checked before anything is computed from it, and the pixel array must fit
+ ** inside the file, so nothing past this point can overflow or read off the end
+ ** (no globals, so loaders can run on any thread):
+ **/
+bool ParseBmpHeader(unsigned char *header, size_t length, size_t filesize, struct bmpformat &fmt) {
+    struct bmfh FileHeader;
+    struct bmih InfoHeader;
+
+    if (length < 14+40) {
+        bmpError("Bmp header is too short\n");
+        return false;
+    }
+
+    FileHeader.bfType = GetShort(&header[0]);
+
+    // if bfType is not 0x4d42, the file is not a bmp:
+    if (FileHeader.bfType != 0x4d42){
+        bmpError("Wrong type of file: 0x%0x\n", FileHeader.bfType);
+        return false;
+    }
+
+    FileHeader.bfSize = GetInt(&header[2]);
+    FileHeader.bfReserved1 = GetShort(&header[6]);
+    FileHeader.bfReserved2 = GetShort(&header[8]);
+    FileHeader.bfOffBits = GetInt(&header[10]);
+
+
+    InfoHeader.biSize = GetInt(&header[14]);
+    InfoHeader.biWidth = GetInt(&header[18]);
+    InfoHeader.biHeight = GetInt(&header[22]);
+    InfoHeader.biPlanes = GetShort(&header[26]);
+    InfoHeader.biBitCount = GetShort(&header[28]);
+    InfoHeader.biCompression = GetInt(&header[30]);
+    InfoHeader.biSizeImage = GetInt(&header[34]);
+    InfoHeader.biXPelsPerMeter = GetInt(&header[38]);
+    InfoHeader.biYPelsPerMeter = GetInt(&header[42]);
+    InfoHeader.biClrUsed = GetInt(&header[46]);
+    InfoHeader.biClrImportant = GetInt(&header[50]);
+
+    // bmpError("Image size found: %d x %d\n", ImageWidth, ImageHeight);
+
+    if (InfoHeader.biSize < 40 || InfoHeader.biPlanes != 1 || InfoHeader.biWidth <= 0 || InfoHeader.biHeight == 0) {
+        bmpError("Bad info header: size %d, %d planes, %d x %d\n", InfoHeader.biSize, InfoHeader.biPlanes, InfoHeader.biWidth, InfoHeader.biHeight);
+        return false;
+    }
+
+    // (checked before the sign comes off, as -INT_MIN does not fit)
+    if (InfoHeader.biWidth > BMP_MAX_DIMENSION || InfoHeader.biHeight > BMP_MAX_DIMENSION || InfoHeader.biHeight < -BMP_MAX_DIMENSION ||
+        (long long)InfoHeader.biWidth * InfoHeader.biHeight > BMP_MAX_PIXELS || (long long)InfoHeader.biWidth * InfoHeader.biHeight < -BMP_MAX_PIXELS) {
+        bmpError("Bmp image is too big: %d x %d\n", InfoHeader.biWidth, InfoHeader.biHeight);
+        return false;
+    }
 
+    fmt.width = InfoHeader.biWidth;
+    fmt.topdown = (InfoHeader.biHeight < 0);
+    fmt.height = fmt.topdown ? -InfoHeader.biHeight : InfoHeader.biHeight;
+    fmt.bits = InfoHeader.biBitCount;
+    fmt.compression = InfoHeader.biCompression;
+    fmt.rowbytes = (int)(4 * (((long long)fmt.bits * fmt.width + 31) / 32));
+    fmt.offset = FileHeader.bfOffBits;
+    fmt.ncomps = 3;
+    fmt.bgra = false;
 
+    // masks follow a 40 byte header, or sit inside a V3/V4/V5 one:
+    size_t tables = 14 + (size_t)InfoHeader.biSize;
 
+    if (fmt.compression == birgb) {
+        switch (fmt.bits) {
+            case 8: {
+                int numcolors = InfoHeader.biClrUsed ? InfoHeader.biClrUsed : 256;
+                if (numcolors < 0 || numcolors > 256 || tables + 4*numcolors > length) {
+                    bmpError("Bad palette: %d colors\n", numcolors);
+                    return false;
+                }
+                // stored as B,G,R,X; kept as R,G,B,X so a word copy lands in order
+                memset(fmt.palette, 0, sizeof(fmt.palette));
+                for (int i = 0; i < numcolors; i++) {
+                    unsigned char *q = &header[tables + 4*i];
+                    fmt.palette[i] = q[2] | (q[1] << 8) | (q[0] << 16);
+                }
+                tables += 4*numcolors;
+                break;
+            }
+            case 16:
+                // X1R5G5B5
+                ParseMask(0x7c00, fmt.channels[0]);
+                ParseMask(0x03e0, fmt.channels[1]);
+                ParseMask(0x001f, fmt.channels[2]);
+                ParseMask(0, fmt.channels[3]);
+                break;
+            case 24:
+                break;
+            case 32:
+                // B,G,R,X: the fourth byte is padding (mostly 0) unless a V4+ header gives it an alpha mask
+                fmt.bgra = true;
+                if (InfoHeader.biSize >= 56 && length >= 14+40+16 && (unsigned int)GetInt(&header[14+40+12]) == 0xff000000)
+                    fmt.ncomps = 4;
+                break;
+            default:
+                bmpError("Wrong number of bits per pixel: %d\n", fmt.bits);
+                return false;
+        }
+    } else if (fmt.compression == bibitfields || fmt.compression == bialphabitfields) {
+        if (fmt.bits != 16 && fmt.bits != 32) {
+            bmpError("Wrong number of bits per pixel for bitfields: %d\n", fmt.bits);
+            return false;
+        }
 
-int ReadInt(FILE *fp) {
-    unsigned char b3, b2, b1, b0;
-    b0 = fgetc(fp);
-    b1 = fgetc(fp);
-    b2 = fgetc(fp);
-    b3 = fgetc(fp);
-    return (b3 << 24)  |  (b2 << 16)  |  (b1 << 8)  |  b0;
+        // alpha is only there with a V4+ header or the ALPHABITFIELDS variant
+        bool hasAlpha = (InfoHeader.biSize >= 56 || fmt.compression == bialphabitfields);
+        size_t masksEnd = 14+40 + (hasAlpha ? 16 : 12);
+        if (masksEnd > length) {
+            bmpError("Bmp header is missing its bitfields\n");
+            return false;
+        }
+
+        unsigned int masks[4];
+        for (int c = 0; c < 4; c++)
+            masks[c] = (c < 3 || hasAlpha) ? (unsigned int)GetInt(&header[14+40 + 4*c]) : 0;
+        for (int c = 0; c < 4; c++) {
+            if (!ParseMask(masks[c], fmt.channels[c])) {
+                bmpError("Bitfields mask 0x%08x is not contiguous\n", masks[c]);
+                return false;
+            }
+        }
+
+        // (no alpha mask, no alpha: the fourth byte is padding then)
+        fmt.ncomps = (masks[3] != 0) ? 4 : 3;
+        fmt.bgra = (fmt.bits == 32 && masks[0] == 0x00ff0000 && masks[1] == 0x0000ff00 &&
+                    masks[2] == 0x000000ff && (masks[3] == 0xff000000 || masks[3] == 0));
+        if (tables < masksEnd) tables = masksEnd;
+    } else {
+        // we do not support compression:
+        bmpError("Wrong type of image compression: %d\n", fmt.compression);
+        return false;
+    }
+
+    if (fmt.offset < 0 || (size_t)fmt.offset < tables) {
+        bmpError("Bmp pixel data overlaps its header (offset %d)\n", fmt.offset);
+        return false;
+    }
+
+    // a short file is turned away here, not after its pixels have been allocated
+    if ((unsigned long long)fmt.offset + (unsigned long long)fmt.rowbytes * fmt.height > filesize) {
+        bmpError("Bmp pixel data runs past the end of the file (%d x %d from offset %d, %llu bytes)\n",
+                 fmt.width, fmt.height, fmt.offset, (unsigned long long)filesize);
+        return false;
+    }
+
+    return true;
 }
 
-short ReadShort(FILE *fp) {
-    unsigned char b1, b0;
-    b0 = fgetc(fp);
-    b1 = fgetc(fp);
-    return (b1 << 8)  |  b0;
+/**
+ ** convert the raw rows (in file order) into tightly packed RGB or RGBA rows,
+ ** bottom row first; in place for 24 and 32 bit images (dst == src), where the
+ ** output row is never wider than the file row
+ **/
+void DecodeBmpRows(unsigned char *dst, unsigned char *src, struct bmpformat &fmt, int outcomps) {
+    static const int bgraToRgba[4] = { 2, 1, 0, 3 };
+    static const int rgbaToRgb[4] = { 0, 1, 2, 3 };
+    int outrow = outcomps * fmt.width;
+    unsigned char *scratch = NULL;
+    bool unpacked = (fmt.bits == 16 || (fmt.bits == 32 && !fmt.bgra));
+    if (unpacked && outcomps == 3)
+        scratch = new unsigned char[4 * fmt.width];
+
+    for (int t = 0; t < fmt.height; t++) {
+        // in place rows must go in file order, the flip happens afterwards
+        int from = (fmt.topdown && dst != src) ? fmt.height - 1 - t : t;
+        unsigned char *in = src + (size_t)from * fmt.rowbytes;
+        unsigned char *out = dst + (size_t)t * outrow;
+
+        if (fmt.bits == 8)
+            ExpandPaletteRow(out, in, fmt.palette, fmt.width);
+        else if (fmt.bits == 24)
+            SwizzleBgrRow(out, in, 3 * fmt.width);
+        else if (fmt.bgra)
+            ShuffleQuadRow(out, in, fmt.width, bgraToRgba, outcomps);
+        else if (scratch != NULL) {
+            UnpackBitfieldsRow(scratch, in, fmt.width, fmt.bits, fmt.channels);
+            ShuffleQuadRow(out, scratch, fmt.width, rgbaToRgb, 3);
+        } else
+            UnpackBitfieldsRow(out, in, fmt.width, fmt.bits, fmt.channels);
+    }
+
+    if (fmt.topdown && dst == src)
+        FlipRows(dst, outrow, fmt.height);
+    delete [] scratch;
 }
 
 /**
- ** read a BMP file into a Texture:
+ ** read a BMP file into a Texture (RGB, whatever the file holds):
  **/
 unsigned char* BmpToTexture(char *filename, int *width, int *height) {
-    int s, t, e;		// counters
-    int numextra;		// # extra bytes each line in the file is padded with
+    return BmpToImage(filename, width, height, NULL);
+}
+
+// turn the raw pixel array into the image, in place when the rows allow it (raw is used up):
+unsigned char* decodeImage(unsigned char *raw, struct bmpformat &fmt, int outcomps) {
+    bool inplace = (fmt.bits == 24 || fmt.bgra);
+    unsigned char *image = inplace ? raw : new unsigned char[ (size_t)outcomps * fmt.width * fmt.height ];
+    DecodeBmpRows(image, raw, fmt, outcomps);
+    if (!inplace) delete [] raw;
+    return image;
+}
+
+/**
+ ** read a BMP file into an RGB or RGBA image: files with an alpha mask (32 bit
+ ** ones with a V4+ header, BITFIELDS and ALPHABITFIELDS) come back as RGBA,
+ ** everything else as RGB (ncomps gets 3 or 4; pass NULL to always get RGB)
+ **/
+unsigned char* BmpToImage(char *filename, int *width, int *height, int *ncomps) {
     FILE *fp;
-    unsigned char *texture;
-    int nums, numt;
-    unsigned char *tp;
-    
-    
+    unsigned char header[BMP_MAX_HEADER];
+
+
     fp = fopen(filename, "rb");
     if (fp == NULL) {
         fprintf(stderr, "Cannot open Bmp file '%s'\n", filename);
         return NULL;
     }
-    
-    FileHeader.bfType = ReadShort(fp);
-    
-    // if bfType is not 0x4d42, the file is not a bmp:
-    if (FileHeader.bfType != 0x4d42){
-        fprintf(stderr, "Wrong type of file: 0x%0x\n", FileHeader.bfType);
-        fclose(fp);
-        return NULL;
+
+    struct stat st;
+    size_t filesize = (fstat(fileno(fp), &st) == 0) ? (size_t)st.st_size : 0;
+
+    // the header runs up to the pixel array, palette and masks included
+    size_t length = 14;
+    if (fread(header, 1, 14, fp) == 14) {
+        int offset = GetInt(&header[10]);
+        length = (offset > 14 && offset < BMP_MAX_HEADER) ? offset : BMP_MAX_HEADER;
+        length = 14 + fread(&header[14], 1, length - 14, fp);
     }
-    
-    FileHeader.bfSize = ReadInt(fp);
-    FileHeader.bfReserved1 = ReadShort(fp);
-    FileHeader.bfReserved2 = ReadShort(fp);
-    FileHeader.bfOffBits = ReadInt(fp);
-    
-    
-    InfoHeader.biSize = ReadInt(fp);
-    InfoHeader.biWidth = ReadInt(fp);
-    InfoHeader.biHeight = ReadInt(fp);
-    
-    nums = InfoHeader.biWidth;
-    numt = InfoHeader.biHeight;
-    
-    InfoHeader.biPlanes = ReadShort(fp);
-    InfoHeader.biBitCount = ReadShort(fp);
-    InfoHeader.biCompression = ReadInt(fp);
-    InfoHeader.biSizeImage = ReadInt(fp);
-    InfoHeader.biXPelsPerMeter = ReadInt(fp);
-    InfoHeader.biYPelsPerMeter = ReadInt(fp);
-    InfoHeader.biClrUsed = ReadInt(fp);
-    InfoHeader.biClrImportant = ReadInt(fp);
-    
-    // fprintf(stderr, "Image size found: %d x %d\n", ImageWidth, ImageHeight);
-    
-    texture = new unsigned char[ 3 * nums * numt ];
-    if (texture == NULL) {
-        fprintf(stderr, "Cannot allocate the texture array!\b");
+
+    // nothing is allocated for the pixels until the header says they are all there
+    struct bmpformat *fmt = new struct bmpformat;
+    if (!ParseBmpHeader(header, length, filesize, *fmt) || fseek(fp, fmt->offset, SEEK_SET) != 0) {
+        fprintf(stderr, "Cannot read Bmp file '%s'\n", filename);
+        delete fmt;
+        fclose(fp);
         return NULL;
     }
-    
-    // extra padding bytes:
-    numextra =  4*(((3*InfoHeader.biWidth)+3)/4) - 3*InfoHeader.biWidth;
-    
-    // we do not support compression:
-    if (InfoHeader.biCompression != birgb) {
-        fprintf(stderr, "Wrong type of image compression: %d\n", InfoHeader.biCompression);
+
+    // the whole pixel array comes in with one read, padding and all; 24 and 32 bit
+    // rows are then converted in place, the rest into a buffer of their own
+    unsigned char *raw = new unsigned char[ (size_t)fmt->rowbytes * fmt->height ];
+    if (fread(raw, fmt->rowbytes, fmt->height, fp) != (size_t)fmt->height) {
+        fprintf(stderr, "Bmp file '%s' is missing pixel data\n", filename);
+        delete [] raw;
+        delete fmt;
         fclose(fp);
         return NULL;
     }
-    
-    rewind(fp);
-    fseek(fp, 14+40, SEEK_SET);
-    
-    if (InfoHeader.biBitCount == 24) {
-        for (t = 0, tp = texture; t < numt; t++) {
-            for (s = 0; s < nums; s++, tp += 3)  {
-                *(tp+2) = fgetc(fp);		// b
-                *(tp+1) = fgetc(fp);		// g
-                *(tp+0) = fgetc(fp);		// r
-            }
-            
-            for (e = 0; e < numextra; e++)
-                fgetc(fp);
-        }
-    }
-    
     fclose(fp);
-    
-    *width = nums;
-    *height = numt;
+
+    int outcomps = (ncomps != NULL) ? fmt->ncomps : 3;
+    unsigned char *texture = decodeImage(raw, *fmt, outcomps);
+
+    *width = fmt->width;
+    *height = fmt->height;
+    if (ncomps != NULL) *ncomps = outcomps;
+    delete fmt;
     return texture;
 }
+
+/**
+ ** decode a whole BMP file that is already in memory (length bytes of it),
+ ** the same way as BmpToImage; NULL if it is malformed or cut short
+ **/
+unsigned char* BmpDecode(unsigned char *bytes, size_t length, int *width, int *height, int *ncomps) {
+    struct bmpformat *fmt = new struct bmpformat;
+    if (!ParseBmpHeader(bytes, (length < BMP_MAX_HEADER) ? length : BMP_MAX_HEADER, length, *fmt)) {
+        delete fmt;
+        return NULL;
+    }
+
+    size_t rawbytes = (size_t)fmt->rowbytes * fmt->height;
+    unsigned char *raw = new unsigned char[ rawbytes ];
+    memcpy(raw, bytes + fmt->offset, rawbytes);
+
+    int outcomps = (ncomps != NULL) ? fmt->ncomps : 3;
+    unsigned char *image = decodeImage(raw, *fmt, outcomps);
+
+    *width = fmt->width;
+    *height = fmt->height;
+    if (ncomps != NULL) *ncomps = outcomps;
+    delete fmt;
+    return image;
+}
+
+/**
+ ** map a BMP file into memory and point at its pixel rows, without copying them
+ ** (format is 0 when GL cannot take the rows as they are; decode those instead):
+ **/
+bool BmpMap(char *filename, BmpMapping *map) {
+    memset(map, 0, sizeof(BmpMapping));
+
+#ifdef WIN32
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "Cannot open Bmp file '%s'\n", filename);
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        fprintf(stderr, "Cannot open Bmp file '%s'\n", filename);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL) {
+        fprintf(stderr, "Cannot map Bmp file '%s'\n", filename);
+        return false;
+    }
+    map->base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    map->length = (size_t)size.QuadPart;
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot open Bmp file '%s'\n", filename);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        fprintf(stderr, "Cannot open Bmp file '%s'\n", filename);
+        return false;
+    }
+    map->length = (size_t)st.st_size;
+    map->base = mmap(NULL, map->length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map->base == MAP_FAILED) map->base = NULL;
+#endif
+
+    if (map->base == NULL) {
+        fprintf(stderr, "Cannot map Bmp file '%s'\n", filename);
+        return false;
+    }
+
+    unsigned char *bytes = (unsigned char*)map->base;
+    struct bmpformat *fmt = new struct bmpformat;
+    if (!ParseBmpHeader(bytes, map->length, map->length, *fmt)) {
+        delete fmt;
+        BmpUnmap(map);
+        return false;
+    }
+
+    map->width = fmt->width;
+    map->height = fmt->height;
+    map->rowbytes = fmt->rowbytes;
+    map->ncomps = fmt->ncomps;
+    map->pixels = bytes + fmt->offset;
+
+    // bottom-up 24 bit and plain BGRA rows go to GL untouched (BGRX rows, whose
+    // fourth byte is not alpha, are decoded)
+    if (!fmt->topdown && fmt->bits == 24)
+        map->format = GL_BGR;
+    else if (!fmt->topdown && fmt->bgra && fmt->ncomps == 4)
+        map->format = GL_BGRA;
+    delete fmt;
+    return true;
+}
+
+void BmpUnmap(BmpMapping *map) {
+    if (map->base == NULL) return;
+#ifdef WIN32
+    UnmapViewOfFile(map->base);
+#else
+    munmap(map->base, map->length);
+#endif
+    map->base = NULL;
+    map->pixels = NULL;
+}
+
+/**
+ ** load a BMP file straight into the currently bound 2D texture:
+ ** GL reads the BGR(A) rows out of the mapped file itself, and the 4 byte
+ ** unpack alignment skips the padding at the end of each row;
+ ** anything else is decoded first
+ **/
+bool BmpTexImage2D(char *filename, int *width, int *height) {
+    BmpMapping map;
+    if (!BmpMap(filename, &map))
+        return false;
+
+    if (map.format == 0) {
+        BmpUnmap(&map);
+        int ncomps;
+        unsigned char *image = BmpToImage(filename, width, height, &ncomps);
+        if (image == NULL)
+            return false;
+        GLenum format = (ncomps == 4) ? GL_RGBA : GL_RGB;
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, *width, *height, 0, format, GL_UNSIGNED_BYTE, image);
+        delete [] image;
+        return true;
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glTexImage2D(GL_TEXTURE_2D, 0, (map.ncomps == 4) ? GL_RGBA : GL_RGB, map.width, map.height, 0, map.format, GL_UNSIGNED_BYTE, map.pixels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    *width = map.width;
+    *height = map.height;
+    BmpUnmap(&map);
+    return true;
+}
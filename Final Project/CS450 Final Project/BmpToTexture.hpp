@@ -9,8 +9,52 @@
 #ifndef BmpToTexture_hpp
 #define BmpToTexture_hpp
 
+#ifdef WIN32
+#include <windows.h>
+#pragma warning(disable:4996)
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <GL/glu.h>
+#include <GL/glut.h>
+#else
+#include <GLUT/glut.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
 #include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+
+// anything wider, taller or bigger is rejected before a byte of it is allocated:
+#define BMP_MAX_DIMENSION   65536
+#define BMP_MAX_PIXELS      (1 << 30)
+
+// a BMP file mapped read-only into memory:
+typedef struct {
+    void *base;                 // start of the mapping
+    size_t length;              // bytes mapped
+    unsigned char *pixels;      // first row of the pixel array (at bfOffBits)
+    int width, height;
+    int rowbytes;               // bytes per row in the file, padding included
+    int ncomps;                 // components the image decodes to (3 or 4)
+    GLenum format;              // GL_BGR, or GL_BGRA for rows with alpha, if GL can read them as they are, else 0
+} BmpMapping;
 
 unsigned char* BmpToTexture(char *filename, int *width, int *height);
+unsigned char* BmpToImage(char *filename, int *width, int *height, int *ncomps);
+void SwizzleBgrRow(unsigned char *dst, unsigned char *src, int numbytes);
+
+unsigned char* BmpDecode(unsigned char *bytes, size_t length, int *width, int *height, int *ncomps);
+
+extern bool BmpQuiet;       // keep malformed file complaints off stderr
+
+bool BmpMap(char *filename, BmpMapping *map);
+void BmpUnmap(BmpMapping *map);
+bool BmpTexImage2D(char *filename, int *width, int *height);
 
 #endif /* BmpToTexture_hpp */
@@ -0,0 +1,102 @@
+//
+//  analysis_arena.cpp
+//  CS450 Final Project
+//
+//  All analysis buffers live in one aligned block that is allocated once.
+//  Each stage reserves room for its largest length up front, so changing the
+//  length later only re-lays the rows out inside that stage's region.
+//
+
+#include "analysis_arena.hpp"
+
+#ifdef WIN32
+#include <malloc.h>
+#endif
+
+typedef struct {
+    int channels;           // rows in this stage
+    int capacity;           // floats reserved for the whole stage
+    int length;             // floats in use per row
+    float *base;            // start of the stage's region in the block
+    float **rows;           // one pointer per channel
+} ArenaStage;
+
+ArenaStage  stages[ARENA_NUM_STAGES];
+float*      arenaBlock = NULL;
+size_t      arenaFloats = 0;
+
+static int padded(int length) {
+    return (int)((length + ARENA_ROW_PAD - 1) / ARENA_ROW_PAD * ARENA_ROW_PAD);
+}
+
+void cleanAnalysisArena() {
+    puts("Cleaning analysis arena");
+
+    for (int s = 0; s < ARENA_NUM_STAGES; s++)
+        delete [] stages[s].rows;
+#ifdef WIN32
+    _aligned_free(arenaBlock);
+#else
+    free(arenaBlock);
+#endif
+}
+
+// set aside room for a stage (call before InitAnalysisArena):
+void arenaReserve(int stage, int channels, int maxLength) {
+    stages[stage].channels = channels;
+    stages[stage].capacity = channels * padded(maxLength);
+    stages[stage].length = maxLength;
+}
+
+void InitAnalysisArena() {
+    arenaFloats = 0;
+    for (int s = 0; s < ARENA_NUM_STAGES; s++)
+        arenaFloats += stages[s].capacity;
+
+#ifdef WIN32
+    arenaBlock = (float*)_aligned_malloc(arenaFloats * sizeof(float), ARENA_ALIGN);
+#else
+    if (posix_memalign((void**)&arenaBlock, ARENA_ALIGN, arenaFloats * sizeof(float)) != 0)
+        arenaBlock = NULL;
+#endif
+    if (arenaBlock == NULL) {
+        fprintf(stderr, "Cannot allocate the analysis arena!\n");
+        exit(-1);
+    }
+
+    float *next = arenaBlock;
+    for (int s = 0; s < ARENA_NUM_STAGES; s++) {
+        stages[s].base = next;
+        stages[s].rows = new float*[stages[s].channels > 0 ? stages[s].channels : 1];
+        next += stages[s].capacity;
+        arenaResize(s, stages[s].length);
+    }
+
+    atexit(cleanAnalysisArena);
+}
+
+// lay a stage's rows out for a new length and clear them
+// (returns false, leaving the stage untouched, if it was not reserved that big)
+bool arenaResize(int stage, int length) {
+    ArenaStage *st = &stages[stage];
+    int stride = padded(length);
+    if (stride * st->channels > st->capacity) return false;
+
+    st->length = length;
+    for (int c = 0; c < st->channels; c++)
+        st->rows[c] = st->base + c * stride;
+    memset(st->base, 0, stride * st->channels * sizeof(float));
+    return true;
+}
+
+float** arenaStage(int stage) {
+    return stages[stage].rows;
+}
+
+int arenaLength(int stage) {
+    return stages[stage].length;
+}
+
+int arenaChannels(int stage) {
+    return stages[stage].channels;
+}
@@ -0,0 +1,36 @@
+//
+//  analysis_arena.hpp
+//  CS450 Final Project
+//
+
+#ifndef analysis_arena_hpp
+#define analysis_arena_hpp
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// rows start on cache line boundaries (also enough for aligned AVX loads):
+#define ARENA_ALIGN     64
+#define ARENA_ROW_PAD   (ARENA_ALIGN / sizeof(float))
+
+// every buffer the analysis pipeline works in:
+enum ArenaStages {
+    ARENA_SPECTRUM,         // resampled spectrum of the newest frame
+    ARENA_ENVELOPE,         // smoothed spectrum state
+    ARENA_PEAK,             // held peaks
+    ARENA_HOLD,             // peak hold timers
+    ARENA_FLUX,             // previous frame's magnitudes for onset detection
+    ARENA_HISTORY,          // recent analysed spectra for latency compensation
+    ARENA_NUM_STAGES
+};
+
+void arenaReserve(int stage, int channels, int maxLength);
+void InitAnalysisArena();
+
+bool arenaResize(int stage, int length);
+float** arenaStage(int stage);
+int arenaLength(int stage);
+int arenaChannels(int stage);
+
+#endif /* analysis_arena_hpp */
@@ -0,0 +1,218 @@
+//
+//  beat.cpp
+//  CS450 Final Project
+//
+//  Beat tracking from the raw FFT: spectral flux over the low bins picks out
+//  onsets, the intervals between them vote for a tempo, and a beat grid at that
+//  tempo is nudged toward onsets landing near it. Animate() reads the grid as
+//  BeatCount, BeatPhase and BeatHit.
+//
+
+#include "beat.hpp"
+
+// flux history used for the adaptive onset threshold (~1 second of frames):
+#define FLUX_HISTORY    64
+// onsets remembered for inter-onset interval voting:
+#define ONSET_HISTORY   24
+// shortest allowed gap between two onsets (seconds):
+#define MIN_ONSET_GAP   0.1f
+// compression applied to the magnitudes before differencing:
+#define FLUX_COMPRESS   100.f
+
+#define TEMPO_BINS      (BEAT_MAX_BPM - BEAT_MIN_BPM + 1)
+
+float   BeatPhase;
+float   BeatBPM;
+int     BeatCount;
+bool    BeatHit;
+
+float   fluxHist[FLUX_HISTORY];     // ring buffer of recent flux values
+int     fluxHead = 0;
+int     fluxCount = 0;
+float   fluxPrev[2];                // last two flux values for peak picking
+float   fluxPrevTime;
+
+float   onsetTimes[ONSET_HISTORY];  // ring buffer of onset content times
+int     onsetHead = 0;
+int     onsetCount = 0;
+
+float   tempoScore[TEMPO_BINS];     // decaying inter-onset interval votes
+float   beatAnchor;                 // content time of a reference beat
+int     anchorBeats;                // whole beats since the lock at beatAnchor
+float   lastAnalysisTime = -1;
+int     fluxMaxBins = 0;            // most bins reserved in the arena
+
+void resetBeat() {
+    BeatPhase = 0;
+    BeatBPM = 0;
+    BeatCount = 0;
+    BeatHit = false;
+    anchorBeats = 0;
+
+    fluxHead = fluxCount = 0;
+    fluxPrev[0] = fluxPrev[1] = 0;
+    onsetHead = onsetCount = 0;
+    memset(tempoScore, 0, sizeof(tempoScore));
+    if (arenaStage(ARENA_FLUX)) arenaResize(ARENA_FLUX, arenaLength(ARENA_FLUX));
+}
+
+// reserve the previous-frame magnitudes (lower quarter of the FFT bins, for the
+// longest FFT there will be) in the arena:
+void InitBeat(int maxFftLength) {
+    fluxMaxBins = maxFftLength / 4;
+    arenaReserve(ARENA_FLUX, 2, fluxMaxBins);
+    resetBeat();
+}
+
+// vote for every tempo implied by the intervals between this onset and earlier ones:
+void voteTempo(float t) {
+    for (int i = 0; i < TEMPO_BINS; i++)
+        tempoScore[i] *= 0.95f;
+
+    for (int i = 0; i < onsetCount; i++) {
+        float dt = t - onsetTimes[i];
+        if (dt < 0.25f || dt > 2.f) continue;
+
+        float bpm = 60.f / dt;
+        while (bpm < BEAT_MIN_BPM) bpm *= 2;
+        while (bpm > BEAT_MAX_BPM) bpm /= 2;
+
+        int bin = (int)(bpm - BEAT_MIN_BPM + 0.5f);
+        tempoScore[bin] += 1.f;
+        if (bin > 0)            tempoScore[bin-1] += 0.5f;
+        if (bin < TEMPO_BINS-1) tempoScore[bin+1] += 0.5f;
+    }
+
+    int best = 0;
+    for (int i = 1; i < TEMPO_BINS; i++)
+        if (tempoScore[i] > tempoScore[best]) best = i;
+
+    // need a few consistent intervals before trusting the tempo
+    if (tempoScore[best] < 4.f) return;
+
+    // parabolic interpolation around the peak for a sub-BPM estimate:
+    float offset = 0;
+    if (best > 0 && best < TEMPO_BINS-1) {
+        float a = tempoScore[best-1], b = tempoScore[best], c = tempoScore[best+1];
+        float denom = a - 2*b + c;
+        if (denom != 0) offset = 0.5f * (a - c) / denom;
+    }
+
+    float bpm = BEAT_MIN_BPM + best + offset;
+    if (BeatBPM == 0) {
+        beatAnchor = t;
+        anchorBeats = 0;
+    } else if (bpm != BeatBPM) {
+        // move the anchor up to the last beat of the old grid, so the new tempo
+        // only changes the beats from here on (not all those already counted)
+        float oldPeriod = 60.f / BeatBPM;
+        int whole = (int)floorf((t - beatAnchor) / oldPeriod);
+        if (whole > 0) {
+            beatAnchor += whole * oldPeriod;
+            anchorBeats += whole;
+        }
+    }
+    BeatBPM = bpm;
+}
+
+// nudge the beat grid toward onsets that land close to a predicted beat:
+void alignPhase(float t) {
+    if (BeatBPM == 0) return;
+
+    float period = 60.f / BeatBPM;
+    float beats = (t - beatAnchor) / period;
+    float err = (beats - floorf(beats + 0.5f)) * period;
+    if (fabsf(err) < 0.25f * period)
+        beatAnchor += 0.25f * err;
+}
+
+void addOnset(float t) {
+    voteTempo(t);
+    alignPhase(t);
+
+    onsetTimes[onsetHead] = t;
+    onsetHead = (onsetHead + 1) % ONSET_HISTORY;
+    if (onsetCount < ONSET_HISTORY) onsetCount++;
+}
+
+// spectral flux onset detection over the raw FFT magnitudes:
+void detectOnset(float **spectrum, int numchannels, int length, float contentTime) {
+    // nothing new to analyse while paused, and start over if playback jumped back
+    if (contentTime == lastAnalysisTime) return;
+    if (contentTime < lastAnalysisTime) resetBeat();
+    lastAnalysisTime = contentTime;
+
+    if (numchannels < 1 || length < 1) return;
+    if (numchannels > 2) numchannels = 2;
+
+    // only the lower quarter of the spectrum carries the rhythm we care about
+    int bins = length / 4;
+    if (bins > fluxMaxBins) {
+        static int rejected = 0;
+        if (length != rejected)
+            fprintf(stderr, "FFT of %d bins is over the %d reserved for onset detection\n", length, 4 * fluxMaxBins);
+        rejected = length;
+        return;
+    }
+    if (bins != arenaLength(ARENA_FLUX) && !arenaResize(ARENA_FLUX, bins)) return;
+
+    float flux = 0;
+    for (int channel = 0; channel < numchannels; channel++) {
+        float *prev = arenaStage(ARENA_FLUX)[channel];
+        for (int bin = 0; bin < bins; bin++) {
+            float mag = logf(1.f + FLUX_COMPRESS * spectrum[channel][bin]);
+            float rise = mag - prev[bin];
+            if (rise > 0) flux += rise;
+            prev[bin] = mag;
+        }
+    }
+    flux /= numchannels * bins;
+
+    // adaptive threshold from the mean and deviation of recent flux:
+    float mean = 0, var = 0;
+    for (int i = 0; i < fluxCount; i++) mean += fluxHist[i];
+    if (fluxCount) mean /= fluxCount;
+    for (int i = 0; i < fluxCount; i++) var += (fluxHist[i] - mean) * (fluxHist[i] - mean);
+    if (fluxCount) var /= fluxCount;
+    float threshold = mean + 1.5f * sqrtf(var);
+
+    // the previous frame is an onset if it was a local maximum above threshold
+    bool peak = fluxPrev[1] > fluxPrev[0] && fluxPrev[1] >= flux && fluxPrev[1] > threshold;
+    if (peak && fluxCount == FLUX_HISTORY) {
+        float last = onsetCount ? onsetTimes[(onsetHead + ONSET_HISTORY - 1) % ONSET_HISTORY] : -1.f;
+        if (onsetCount == 0 || fluxPrevTime - last > MIN_ONSET_GAP)
+            addOnset(fluxPrevTime);
+    }
+
+    fluxPrev[0] = fluxPrev[1];
+    fluxPrev[1] = flux;
+    fluxPrevTime = contentTime;
+
+    fluxHist[fluxHead] = flux;
+    fluxHead = (fluxHead + 1) % FLUX_HISTORY;
+    if (fluxCount < FLUX_HISTORY) fluxCount++;
+}
+
+// evaluate the beat grid at a stream time (call once per Animate(), with the time on screen):
+void updateBeatClock(float time) {
+    BeatHit = false;
+    if (BeatBPM == 0) {
+        BeatPhase = 0;
+        return;
+    }
+
+    float beats = (time - beatAnchor) * BeatBPM / 60.f;
+    if (beats < 0) beats = 0;
+    int whole = (int)floorf(beats);
+    int count = anchorBeats + whole;
+
+    // the count only goes forward: a grid nudged back holds at the start of
+    // the beat until it catches up, and a skipped beat is not a hit
+    if (count < BeatCount) {
+        BeatPhase = 0;
+        return;
+    }
+    BeatPhase = beats - whole;
+    BeatHit = (count == BeatCount + 1);
+    BeatCount = count;
+}
@@ -0,0 +1,29 @@
+//
+//  beat.hpp
+//  CS450 Final Project
+//
+
+#ifndef beat_hpp
+#define beat_hpp
+
+#include <stdio.h>
+#include <cmath>
+#include <string.h>
+#include "analysis_arena.hpp"
+
+// tempo range the tracker will report (octave errors get folded into it):
+#define BEAT_MIN_BPM    80
+#define BEAT_MAX_BPM    180
+
+extern float    BeatPhase;              // position within the current beat [0., 1.)
+extern float    BeatBPM;                // tracked tempo (0 until a tempo locks)
+extern int      BeatCount;              // number of whole beats since the tempo locked
+extern bool     BeatHit;                // true on the first Animate() of each new beat
+
+void InitBeat(int maxFftLength);
+// times are stream times: onsets at the content time of the FFT (the middle of
+// its window), the clock at whatever part of the stream is on screen
+void detectOnset(float **spectrum, int numchannels, int length, float contentTime);
+void updateBeatClock(float time);
+
+#endif /* beat_hpp */
@@ -0,0 +1,308 @@
+//
+//  bmp_bench.cpp
+//  CS450 Final Project
+//
+//  Times texture loading against the original byte-at-a-time loader, then
+//  feeds the decoder damaged copies of the file to show malformed assets are
+//  turned away quickly (and without reading out of bounds). Last, it cuts the
+//  image into tiles and packs them into a texture atlas, checking each tile
+//  reads back through its atlas coordinates, and builds its gamma-correct mip
+//  chain, checking white and black come out of the filter unchanged.
+//  Run the visualizer with:  -bmpbench <file.bmp> [iterations]
+//
+
+#include "bmp_bench.hpp"
+
+// the original loader: one fgetc per byte (kept here only as the baseline)
+unsigned char* LegacyBmpToTexture(char *filename, int *width, int *height) {
+    FILE *fp = fopen(filename, "rb");
+    if (fp == NULL) return NULL;
+
+    fseek(fp, 18, SEEK_SET);
+    unsigned char b[4];
+    for (int i = 0; i < 4; i++) b[i] = fgetc(fp);
+    int nums = (b[3] << 24) | (b[2] << 16) | (b[1] << 8) | b[0];
+    for (int i = 0; i < 4; i++) b[i] = fgetc(fp);
+    int numt = (b[3] << 24) | (b[2] << 16) | (b[1] << 8) | b[0];
+
+    unsigned char *texture = new unsigned char[ 3 * nums * numt ];
+    int numextra = 4*(((3*nums)+3)/4) - 3*nums;
+
+    fseek(fp, 14+40, SEEK_SET);
+    unsigned char *tp = texture;
+    for (int t = 0; t < numt; t++) {
+        for (int s = 0; s < nums; s++, tp += 3)  {
+            *(tp+2) = fgetc(fp);		// b
+            *(tp+1) = fgetc(fp);		// g
+            *(tp+0) = fgetc(fp);		// r
+        }
+
+        for (int e = 0; e < numextra; e++)
+            fgetc(fp);
+    }
+    fclose(fp);
+
+    *width = nums;
+    *height = numt;
+    return texture;
+}
+
+typedef unsigned char* (*Loader)(char *, int *, int *);
+
+// best-of-n throughput in MB of decoded texture per second:
+double TimeLoader(Loader load, char *filename, int iterations, unsigned char **out, int *width, int *height) {
+    double best = 0;
+    for (int i = 0; i < iterations; i++) {
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        unsigned char *texture = load(filename, width, height);
+        std::chrono::duration<double> secs = std::chrono::high_resolution_clock::now() - start;
+
+        if (texture == NULL) return 0;
+        double mbps = 3. * *width * *height / (1024. * 1024.) / secs.count();
+        if (mbps > best) best = mbps;
+
+        if (i == iterations-1) *out = texture;
+        else delete [] texture;
+    }
+    return best;
+}
+
+// header fields worth setting to something hostile:
+const int HOSTILE_FIELDS[] = { 2, 10, 14, 18, 22, 26, 28, 30, 46 };
+const unsigned int HOSTILE_VALUES[] = { 0, 1, 0xffffffff, 0x7fffffff, 0x80000000, 0x10000, 0x10001 };
+
+/**
+ ** decode damaged copies of a file: bytes of the header scribbled on, a field set
+ ** to an extreme, or the file cut short; each copy is put back afterwards
+ **/
+void FuzzDecoder(unsigned char *bytes, size_t length, int count) {
+    size_t headerLength = std::min(length, (size_t)200);
+    std::vector<unsigned char> saved(bytes, bytes + headerLength);
+    int rejected = 0, decoded = 0;
+    double rejectSecs = 0;
+
+    BmpQuiet = true;
+    srand(450);
+    for (int i = 0; i < count; i++) {
+        size_t size = length;
+        switch (rand() % 3) {
+            case 0:
+                for (int n = 1 + rand() % 8; n > 0; n--)
+                    bytes[rand() % headerLength] = (unsigned char)rand();
+                break;
+            case 1: {
+                int field = HOSTILE_FIELDS[rand() % (sizeof(HOSTILE_FIELDS) / sizeof(int))];
+                unsigned int value = HOSTILE_VALUES[rand() % (sizeof(HOSTILE_VALUES) / sizeof(int))];
+                if (field + 4 <= (int)headerLength)
+                    for (int b = 0; b < 4; b++)
+                        bytes[field + b] = (unsigned char)(value >> (8*b));
+                break;
+            }
+            default:
+                size = (size_t)(((double)rand() / RAND_MAX) * length);
+                break;
+        }
+
+        int width, height, ncomps;
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        unsigned char *image = BmpDecode(bytes, size, &width, &height, &ncomps);
+        std::chrono::duration<double> secs = std::chrono::high_resolution_clock::now() - start;
+        if (image == NULL) {
+            rejected++;
+            rejectSecs += secs.count();
+        } else {
+            decoded++;
+            delete [] image;
+        }
+
+        memcpy(bytes, &saved[0], headerLength);
+    }
+    BmpQuiet = false;
+
+    fprintf(stderr, "  fuzzed:        %d damaged copies: %d rejected (%.2f us each), %d still decoded\n",
+            count, rejected, rejected ? 1e6 * rejectSecs / rejected : 0., decoded);
+}
+
+// tiles cut for the atlas check, and their sizes (texels, each way):
+#define ATLAS_BENCH_TILES       64
+#define ATLAS_BENCH_MIN_TILE    8
+#define ATLAS_BENCH_MAX_TILE    128
+
+/**
+ ** cut an RGB image (bottom row first) into tiles of assorted sizes, pack them,
+ ** and read every tile's texels back through AtlasUV() from the packed atlas
+ **/
+void AtlasBenchmark(unsigned char *rgb, int width, int height, int iterations) {
+    std::vector<int> corners;       // x, y of each tile in rgb, in entry order
+    srand(38);
+    for (int i = 0; i < ATLAS_BENCH_TILES; i++) {
+        int span = ATLAS_BENCH_MAX_TILE - ATLAS_BENCH_MIN_TILE + 1;
+        int w = std::min(width, ATLAS_BENCH_MIN_TILE + rand() % span);
+        int h = std::min(height, ATLAS_BENCH_MIN_TILE + rand() % span);
+        int x0 = rand() % (width - w + 1), y0 = rand() % (height - h + 1);
+
+        unsigned char *tile = new unsigned char[3 * (size_t)w * h];
+        for (int y = 0; y < h; y++)
+            memcpy(tile + 3 * (size_t)y * w, rgb + 3 * ((size_t)(y0 + y) * width + x0), 3 * w);
+        char name[32];
+        snprintf(name, sizeof(name), "tile %d", i);
+        if (AtlasAddImage(name, tile, w, h, 3) != (int)corners.size() / 2) break;
+        corners.push_back(x0);
+        corners.push_back(y0);
+    }
+    int tiles = (int)corners.size() / 2;
+
+    unsigned char *atlas = NULL;
+    int size = 0;
+    double best = 0;
+    for (int i = 0; i < iterations; i++) {
+        delete [] atlas;
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        atlas = AtlasPack(ATLAS_MAX_SIZE, &size);
+        std::chrono::duration<double> secs = std::chrono::high_resolution_clock::now() - start;
+        if (atlas == NULL) break;
+        if (best == 0 || secs.count() < best) best = secs.count();
+    }
+    if (atlas == NULL) {
+        fprintf(stderr, "  atlas:         cannot pack %d tiles\n", tiles);
+        AtlasClear();
+        return;
+    }
+
+    // texel centres through the entry's transform land on the texels they came from
+    size_t used = 0;
+    int wrong = 0;
+    for (int i = 0; i < tiles; i++) {
+        AtlasEntry *e = AtlasGetEntry(i);
+        used += (size_t)e->width * e->height;
+        for (int t = 0; t < e->height; t++) {
+            for (int s = 0; s < e->width; s++) {
+                float u, v;
+                AtlasUV(i, (s + .5f) / e->width, (t + .5f) / e->height, &u, &v);
+                size_t texel = (size_t)(v * size) * size + (size_t)(u * size);
+                size_t source = (size_t)(corners[2*i + 1] + t) * width + corners[2*i] + s;
+                if (memcmp(&atlas[4 * texel], &rgb[3 * source], 3) != 0) wrong++;
+            }
+        }
+    }
+
+    fprintf(stderr, "  atlas:         %d tiles in %d x %d (%.0f%% used), packed in %.2f ms, %d texels misplaced\n",
+            tiles, size, size, 100. * used / ((double)size * size), 1000 * best, wrong);
+    delete [] atlas;
+    AtlasClear();
+}
+
+// true if every level of a gamma-correct chain of a flat grey image stays that grey:
+bool MipKeepsFlat(unsigned char grey, int ncomps) {
+    const int size = 8;
+    unsigned char *pixels = new unsigned char[ncomps * size * size];
+    memset(pixels, grey, ncomps * size * size);
+
+    MipChain chain;
+    BuildMipChain(pixels, size, size, ncomps, true, &chain);
+    bool flat = true;
+    for (int l = 1; l < chain.numLevels; l++) {
+        MipLevel *level = &chain.levels[l];
+        for (int i = 0; i < ncomps * level->width * level->height; i++)
+            if (level->pixels[i] != grey) flat = false;
+    }
+    FreeMipChain(&chain);
+    return flat;
+}
+
+// times the gamma-correct mip chain of an RGB image (bottom row first):
+void MipBenchmark(unsigned char *rgb, int width, int height, int iterations) {
+    double best = 0;
+    int levels = 0;
+    for (int i = 0; i < iterations; i++) {
+        unsigned char *pixels = new unsigned char[3 * (size_t)width * height];
+        memcpy(pixels, rgb, 3 * (size_t)width * height);
+        MipChain chain;
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        BuildMipChain(pixels, width, height, 3, true, &chain);
+        std::chrono::duration<double> secs = std::chrono::high_resolution_clock::now() - start;
+        levels = chain.numLevels;
+        FreeMipChain(&chain);
+        if (best == 0 || secs.count() < best) best = secs.count();
+    }
+
+    bool white = MipKeepsFlat(255, 3) && MipKeepsFlat(255, 4);
+    bool black = MipKeepsFlat(0, 3) && MipKeepsFlat(0, 4);
+    fprintf(stderr, "  sRGB mips:     %d levels in %.2f ms, white %s, black %s\n",
+            levels, 1000 * best, white ? "kept" : "CHANGED", black ? "kept" : "CHANGED");
+}
+
+// the whole file in memory, for decoding without the disk:
+unsigned char* ReadWholeFile(char *filename, size_t *length) {
+    FILE *fp = fopen(filename, "rb");
+    if (fp == NULL) return NULL;
+    struct stat st;
+    if (fstat(fileno(fp), &st) != 0) {
+        fclose(fp);
+        return NULL;
+    }
+
+    *length = (size_t)st.st_size;
+    unsigned char *bytes = new unsigned char[*length];
+    if (fread(bytes, 1, *length, fp) != *length) {
+        delete [] bytes;
+        bytes = NULL;
+    }
+    fclose(fp);
+    return bytes;
+}
+
+void BmpBenchmark(char *filename, int iterations) {
+    unsigned char *legacy = NULL, *fast = NULL;
+    int lw = 0, lh = 0, fw = 0, fh = 0;
+
+    // the fgetc loader trusts whatever it is given, so it only gets plain 24 bit files
+    BmpMapping map;
+    bool plain = BmpMap(filename, &map) && map.format == GL_BGR && map.pixels == (unsigned char*)map.base + 14+40;
+    BmpUnmap(&map);
+
+    double legacyRate = plain ? TimeLoader(LegacyBmpToTexture, filename, iterations, &legacy, &lw, &lh) : 0;
+    double fastRate = TimeLoader(BmpToTexture, filename, iterations, &fast, &fw, &fh);
+    if ((plain && legacy == NULL) || fast == NULL) {
+        fprintf(stderr, "Cannot benchmark '%s'\n", filename);
+        delete [] legacy;
+        delete [] fast;
+        return;
+    }
+
+    fprintf(stderr, "%s: %d x %d, best of %d\n", filename, fw, fh, iterations);
+    if (plain) {
+        bool same = (lw == fw && lh == fh && memcmp(legacy, fast, 3 * fw * fh) == 0);
+        fprintf(stderr, "  fgetc loader:  %8.1f MB/s\n", legacyRate);
+        fprintf(stderr, "  bulk loader:   %8.1f MB/s  (%.1fx, output %s)\n",
+                fastRate, fastRate / legacyRate, same ? "identical" : "DIFFERS");
+    } else {
+        fprintf(stderr, "  bulk loader:   %8.1f MB/s\n", fastRate);
+    }
+
+    // the checked decode on its own, to show validation costs the fast path nothing
+    size_t length;
+    unsigned char *bytes = ReadWholeFile(filename, &length);
+    if (bytes != NULL) {
+        double best = 0;
+        for (int i = 0; i < iterations; i++) {
+            int width, height;
+            std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+            unsigned char *image = BmpDecode(bytes, length, &width, &height, NULL);
+            std::chrono::duration<double> secs = std::chrono::high_resolution_clock::now() - start;
+            if (image == NULL) break;
+            best = std::max(best, 3. * width * height / (1024. * 1024.) / secs.count());
+            delete [] image;
+        }
+        fprintf(stderr, "  from memory:   %8.1f MB/s\n", best);
+
+        FuzzDecoder(bytes, length, 200 * iterations);
+        delete [] bytes;
+    }
+
+    AtlasBenchmark(fast, fw, fh, iterations);
+    MipBenchmark(fast, fw, fh, iterations);
+
+    delete [] legacy;
+    delete [] fast;
+}
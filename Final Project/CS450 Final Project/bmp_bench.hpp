@@ -0,0 +1,21 @@
+//
+//  bmp_bench.hpp
+//  CS450 Final Project
+//
+
+#ifndef bmp_bench_hpp
+#define bmp_bench_hpp
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include "BmpToTexture.hpp"
+#include "texture_atlas.hpp"
+#include "mipmap.hpp"
+
+void BmpBenchmark(char *filename, int iterations);
+
+#endif /* bmp_bench_hpp */
@@ -8,13 +8,29 @@
 
 #include "fmod_funcs.hpp"
 
+// one playing file and the FFT tap on it:
+typedef struct {
+    FMOD::Sound      *sound;
+    FMOD::Channel    *channel;
+    FMOD::DSP        *fftdsp;
+    int               firstChannel;     // where its rows start in spec
+    int               numChannels;      // rows it has there (fixed when it starts)
+} Stream;
+
 FMOD::System     *fmod_system;
-FMOD::Sound      *sound;
-FMOD::Channel    *channel = 0;
-FMOD::DSP        *fftdsp;
+Stream            streams[MAX_STREAMS];
+int               numStreams = 0;
 FMOD_RESULT       result;
 unsigned int      version;
 float **spec;
+int numSpec = 0;            // rows of spec the streams have between them
+float **shown;              // spectrum handed to the visuals (possibly delayed)
+int numShown = 0;
+float **peaks = NULL;       // held peaks of the shown spectrum (NULL while peak hold is off)
+int sampleRate = 48000;
+float outputLatency = 0;    // seconds between the mixer and the speakers
+float lastSpecTime = 0;     // audio time of the previous analysis frame
+float lastPeakTime = 0;     // speaker time of the previous peak-hold step
 
 void ERRCHECK_fn(FMOD_RESULT result, const char *file, int line) {
     if (result != FMOD_OK) {
@@ -26,26 +42,121 @@ void ERRCHECK_fn(FMOD_RESULT result, const char *file, int line) {
 void cleanFMOD() {
     puts("Cleaning FMOD resources");
     
-    delete [] spec[1];
-    delete [] spec[0];
-    delete [] spec;
-    
-    ERRCHECK(sound->release());
-    ERRCHECK(fftdsp->release());
+    for (int i = 0; i < numStreams; i++) {
+        ERRCHECK(streams[i].sound->release());
+        ERRCHECK(streams[i].fftdsp->release());
+    }
     ERRCHECK(fmod_system->release());
 }
 
 void switchPaused() {
     bool isPaused;
-    channel->getPaused(&isPaused);
-    channel->setPaused(!isPaused);
+    streams[0].channel->getPaused(&isPaused);
+    for (int i = 0; i < numStreams; i++)
+        streams[i].channel->setPaused(!isPaused);
+}
+
+// playback position of the first stream in seconds (the audio clock):
+float audioTime() {
+    unsigned int ms;
+    result = streams[0].channel->getPosition(&ms, FMOD_TIMEUNIT_MS);
+    if (result != FMOD_OK) return 0;
+    return (float)ms / 1000.f;
+}
+
+// the part of the stream coming out of the speakers right now (the mixer runs ahead by the output buffers):
+float speakerTime() {
+    return audioTime() - outputLatency;
+}
+
+// the part of the stream the newest analysis describes (the FFT window ends at
+// the mixer position, so it is centred half a window earlier):
+float contentTime() {
+    return audioTime() - (float)FFT_WINDOW / 2 / sampleRate;
+}
+
+// the part of the stream the visuals are showing (see lookupSpectrum()):
+float visualTime() {
+    if (LatencyCompensationOn) return speakerTime() + LatencyTrim;
+    return contentTime();
+}
+
+
+// number of analysed channels across all streams (e.g. 2 for stereo, 6 for 5.1):
+int spectrumChannels() {
+    return numShown;
+}
+
+// resampled spectrum of one analysed channel, or NULL if there is no such channel:
+float* spectrumChannel(int channel) {
+    if (!shown || channel < 0 || channel >= numShown) return NULL;
+    return shown[channel];
+}
+
+// held peaks of one channel's spectrum, or NULL (no such channel, or peak hold is off):
+float* peakChannel(int channel) {
+    if (!peaks || channel < 0 || channel >= numShown) return NULL;
+    return peaks[channel];
+}
+
+int streamCount() {
+    return numStreams;
+}
+
+int streamFirstChannel(int stream) {
+    return streams[stream].firstChannel;
+}
+
+int streamChannels(int stream) {
+    return streams[stream].numChannels;
+}
+
+// stream whose rows include channel, or -1:
+int channelStream(int channel) {
+    for (int i = 0; i < numStreams; i++)
+        if (channel >= streams[i].firstChannel && channel < streams[i].firstChannel + streams[i].numChannels)
+            return i;
+    return -1;
+}
+
+// start a file playing with its own FFT tap, and give its channels the next rows of spec:
+void addStream(const char *file) {
+    if (numStreams >= MAX_STREAMS) {
+        fprintf(stderr, "Too many streams, skipping '%s'\n", file);
+        return;
+    }
+    Stream *st = &streams[numStreams];
+    
+    result = fmod_system->createStream(file, FMOD_DEFAULT, 0, &st->sound);
+    ERRCHECK(result);
+    
+    // Play the sound
+    result = fmod_system->playSound(st->sound, 0, false, &st->channel);
+    ERRCHECK(result);
+    
+    fmod_system->createDSPByType(FMOD_DSP_TYPE::FMOD_DSP_TYPE_FFT, &st->fftdsp);
+    //st->fftdsp->setParameterInt(FMOD_DSP_FFT_WINDOWTYPE, FMOD_DSP_FFT_WINDOW_RECT);
+    st->fftdsp->setParameterInt(FMOD_DSP_FFT_WINDOWSIZE, FFT_WINDOW);
+    st->channel->addDSP(FMOD_DSP_PARAMETER_DATA_TYPE_FFT, st->fftdsp);
+    
+    // the rows stay the stream's, so a channel always means the same source
+    int channels = 0;
+    ERRCHECK(st->sound->getFormat(NULL, NULL, &channels, NULL));
+    if (channels > ANALYSIS_MAX_CHANNELS - numSpec) {
+        fprintf(stderr, "Only analysing %d of the %d channels of '%s'\n", ANALYSIS_MAX_CHANNELS - numSpec, channels, file);
+        channels = ANALYSIS_MAX_CHANNELS - numSpec;
+    }
+    st->firstChannel = numSpec;
+    st->numChannels = channels;
+    numSpec += channels;
+    numStreams++;
 }
 
 
 // ================================================================================================
 // Application-independent initialization
 // ================================================================================================
-void InitFMOD(int res) {
+void InitFMOD(int res, int numFiles, char **files) {
     /*
      Create a System object and initialize.
      */
@@ -58,43 +169,93 @@ void InitFMOD(int res) {
         printf("FMOD lib version %08x doesn't match header version %08x", version, FMOD_VERSION);
     }
     
-    /* Disable sound if there are no sound drivers */
-    int numDrivers;
-    result = fmod_system->getNumDrivers(&numDrivers);
-    ERRCHECK(result);
-    if (numDrivers == 0) {
-        result = fmod_system->setOutput(FMOD_OUTPUTTYPE_NOSOUND);
+    FMOD_INITFLAGS flags = FMOD_INIT_NORMAL;
+    if (Headless) {
+        /* No device, and the mixer only runs when update() is called (once a frame),
+         one frame of audio at a time, so frame n hears the same audio every run */
+        ERRCHECK(fmod_system->setOutput(FMOD_OUTPUTTYPE_NOSOUND_NRT));
+        ERRCHECK(fmod_system->setSoftwareFormat(HEADLESS_SAMPLE_RATE, FMOD_SPEAKERMODE_DEFAULT, 0));
+        ERRCHECK(fmod_system->setDSPBufferSize(HEADLESS_SAMPLE_RATE / HEADLESS_FPS, 4));
+        flags = FMOD_INIT_STREAM_FROM_UPDATE | FMOD_INIT_MIX_FROM_UPDATE;
+    } else {
+        /* Disable sound if there are no sound drivers */
+        int numDrivers;
+        result = fmod_system->getNumDrivers(&numDrivers);
         ERRCHECK(result);
+        if (numDrivers == 0) {
+            result = fmod_system->setOutput(FMOD_OUTPUTTYPE_NOSOUND);
+            ERRCHECK(result);
+        }
     }
     
-    result = fmod_system->init(512, FMOD_INIT_NORMAL, NULL);
+    result = fmod_system->init(512, flags, NULL);
     ERRCHECK(result);
     
-//    result = fmod_system->createStream("stairway-to-heaven.mp3", FMOD_DEFAULT, 0, &sound);
-//    result = fmod_system->createStream("rise.mp3", FMOD_DEFAULT, 0, &sound);
-    result = fmod_system->createStream("delta-zone.mp3", FMOD_DEFAULT, 0, &sound);
-    ERRCHECK(result);
-
-    // Play the sound
-    result = fmod_system->playSound(sound, 0, false, &channel);
-    ERRCHECK(result);
+    // everything queued in the output buffers is still to be heard
+    unsigned int bufferLength;
+    int numBuffers;
+    ERRCHECK(fmod_system->getSoftwareFormat(&sampleRate, NULL, NULL));
+    ERRCHECK(fmod_system->getDSPBufferSize(&bufferLength, &numBuffers));
+    outputLatency = (float)(bufferLength * numBuffers) / sampleRate;
     
-    fmod_system->createDSPByType(FMOD_DSP_TYPE::FMOD_DSP_TYPE_FFT, &fftdsp);
-    //fftdsp->setParameterInt(FMOD_DSP_FFT_WINDOWTYPE, FMOD_DSP_FFT_WINDOW_RECT);
-    fftdsp->setParameterInt(FMOD_DSP_FFT_WINDOWSIZE, 2048);
-    channel->addDSP(FMOD_DSP_PARAMETER_DATA_TYPE_FFT, fftdsp);
+    // files given on the command line all play together; otherwise the default track
+    for (int i = 0; i < numFiles; i++)
+        addStream(files[i]);
+    if (numStreams == 0) {
+//        addStream("stairway-to-heaven.mp3");
+//        addStream("rise.mp3");
+        addStream("delta-zone.mp3");
+    }
     
-    spec = new float*[2*sizeof(float*)];
-    spec[0] = new float[res*sizeof(float)];
-    spec[1] = new float[res*sizeof(float)];
+    // every analysis buffer comes out of one aligned arena, sized once here for
+    // the largest resolution, so changing it later never reallocates
+    if (res > ANALYSIS_MAX_RES) {
+        fprintf(stderr, "Spectrum resolution %d is over the maximum of %d\n", res, ANALYSIS_MAX_RES);
+        exit(-1);
+    }
+    arenaReserve(ARENA_SPECTRUM, ANALYSIS_MAX_CHANNELS, ANALYSIS_MAX_RES);
+    InitSpectrumFilter(ANALYSIS_MAX_CHANNELS, ANALYSIS_MAX_RES);
+    InitBeat(FFT_WINDOW / 2);
+    InitLatency(ANALYSIS_MAX_CHANNELS, ANALYSIS_MAX_RES);
+    InitAnalysisArena();
+    spec = arenaStage(ARENA_SPECTRUM);
     
     
     atexit(cleanFMOD);
 }
 
+// spread the low end of one channel's FFT over res bins:
+void resampleChannel(float *fft, float *out, int res) {
+//    for (int channel = 0; channel < 2; channel++)
+//        for (int bin = 0; bin < res; bin++)
+//            spec[channel][bin] = (fftdata->spectrum[channel][bin] +
+//                                  fftdata->spectrum[channel][bin+1] +
+//                                  fftdata->spectrum[channel][bin+2] +
+//                                  fftdata->spectrum[channel][bin+3]) / 4;
+    
+    for (int bin = 0; bin < res-3; bin += 4) {
+        out[bin] = fft[bin/4];
+        out[bin+2] = (fft[bin/4] + fft[bin/4+1]) / 2;
+        out[bin+1] = (out[bin] + out[bin+2]) / 2;
+        out[bin+3] = (out[bin+2] + fft[bin/4+1]) / 2;
+    }
+    out[res-1] = out[0];
+    out[res-2] = 0.33*out[res-4] + 0.67*out[res-1];
+    out[res-3] = 0.67*out[res-4] + 0.33*out[res-1];
+    
+    // also close the seam half way round, so any channel can be drawn
+    // rotated by 180 degrees (as the lower half of the sphere is)
+    out[res/2-1] = out[res/2];
+    out[res/2-2] = 0.33*out[res/2-4] + 0.67*out[res/2-1];
+    out[res/2-3] = 0.67*out[res/2-4] + 0.33*out[res/2-1];
+}
+
 float** freq_analysis(int res) {
     /* Per-frame update code */
-    fmod_system->update();
+    {
+        PROFILE_ZONE("FMOD update");
+        fmod_system->update();
+    }
     
 //    unsigned int len;
 //    char s[256];
@@ -103,40 +264,67 @@ float** freq_analysis(int res) {
 //    fftdsp->getParameterInt(FMOD_DSP_FFT_WINDOWSIZE, &val, s, 256);
 //    printf("Window size: %d. %s\n", val, s);
     
-    FMOD_DSP_PARAMETER_FFT *fftdata;
-    result = fftdsp->getParameterData(FMOD_DSP_FFT_SPECTRUMDATA, (void **)&fftdata, NULL, NULL, 0);
-    ERRCHECK(result);
-    
-//    for (int channel = 0; channel < 2; channel++)
-//        for (int bin = 0; bin < res; bin++)
-//            spec[channel][bin] = (fftdata->spectrum[channel][bin] +
-//                                  fftdata->spectrum[channel][bin+1] +
-//                                  fftdata->spectrum[channel][bin+2] +
-//                                  fftdata->spectrum[channel][bin+3]) / 4;
+    // a new resolution re-lays out the arena rows (no reallocation)
+    if (res > ANALYSIS_MAX_RES) {
+        static int rejected = 0;
+        if (res != rejected)
+            fprintf(stderr, "Spectrum resolution %d is over the maximum of %d\n", res, ANALYSIS_MAX_RES);
+        rejected = res;
+        return NULL;
+    }
+    if (res != arenaLength(ARENA_SPECTRUM)) {
+        if (!arenaResize(ARENA_SPECTRUM, res)) return NULL;
+        spec = arenaStage(ARENA_SPECTRUM);
+    }
     
-    if (fftdata->length < res) return NULL;
-    
-    for (int channel = 0; channel < 2; channel++) {
-        for (int bin = 0; bin < res-3; bin += 4) {
-            spec[channel][bin] = fftdata->spectrum[channel][bin/4];
-            spec[channel][bin+2] = (fftdata->spectrum[channel][bin/4] +
-                                    fftdata->spectrum[channel][bin/4+1]) / 2;
-            spec[channel][bin+1] = (spec[channel][bin] +
-                                    spec[channel][bin+2]) / 2;
-            spec[channel][bin+3] = (spec[channel][bin+2] +
-                                    fftdata->spectrum[channel][bin/4+1]) / 2;
-            
-        }
-        spec[channel][res-1] = spec[channel][0];
-        spec[channel][res-2] = 0.33*spec[channel][res-4] + 0.67*spec[channel][res-1];
-        spec[channel][res-3] = 0.67*spec[channel][res-4] + 0.33*spec[channel][res-1];
+    // every channel of every stream into its own rows of spec (silence for a
+    // stream with nothing to show, rather than its rows going to the next one)
+    int zone = profileBegin("Resample");
+    for (int i = 0; i < numStreams; i++) {
+        Stream *st = &streams[i];
+        
+        FMOD_DSP_PARAMETER_FFT *fftdata;
+        result = st->fftdsp->getParameterData(FMOD_DSP_FFT_SPECTRUMDATA, (void **)&fftdata, NULL, NULL, 0);
+        ERRCHECK(result);
+        
+        // the beat follows the first stream
+        if (i == 0)
+            detectOnset(fftdata->spectrum, fftdata->numchannels, fftdata->length, contentTime());
+        
+        int channels = (fftdata->length < res) ? 0 : fftdata->numchannels;
+        if (channels > st->numChannels) channels = st->numChannels;
+        
+        for (int channel = 0; channel < channels; channel++)
+            resampleChannel(fftdata->spectrum[channel], spec[st->firstChannel + channel], res);
+        for (int channel = channels; channel < st->numChannels; channel++)
+            memset(spec[st->firstChannel + channel], 0, res * sizeof(float));
+    }
+    profileEnd(zone);
+    if (numSpec == 0) {
+        numShown = 0;
+        return NULL;
     }
-    spec[1][res/2-1] = spec[1][res/2];
-    spec[1][res/2-2] = 0.33*spec[1][res/2-4] + 0.67*spec[1][res/2-1];
-    spec[1][res/2-3] = 0.67*spec[1][res/2-4] + 0.33*spec[1][res/2-1];
     
+    // attack/release smoothing, stepped by the audio clock
+    float now = audioTime();
+    zone = profileBegin("Smoothing");
+    filterSpectrum(spec, numSpec, res, now - lastSpecTime);
+    profileEnd(zone);
+    lastSpecTime = now;
     
-
+    // hand out whichever recent frame best matches what is actually being heard
+    recordAnalysisFrame(spec, numSpec, res, contentTime());
+    float heard = speakerTime();
+    shown = lookupSpectrum(heard, &numShown);
+    
+    // peaks of what is shown, stepped by the same clock it was looked up on
+    peaks = NULL;
+    if (PeakHoldOn && shown != NULL) {
+        zone = profileBegin("Peak hold");
+        peaks = holdPeaks(shown, numShown, res, heard - lastPeakTime);
+        profileEnd(zone);
+    }
+    lastPeakTime = heard;
     
 //    // Find max volume
 //    auto maxIterator = std::max_element(&fftdata->spectrum[0][0], &fftdata->spectrum[0][fftdata->length]);
@@ -148,5 +336,5 @@ float** freq_analysis(int res) {
 //        std::transform(&fftdata->spectrum[1][0], &fftdata->spectrum[1][fftdata->length], &fftdata->spectrum[1][0], [maxVol] (float dB) -> float { return dB / maxVol; });
 //    }
     
-    return spec;
+    return shown;
 }
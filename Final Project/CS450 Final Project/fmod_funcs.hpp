@@ -16,11 +16,37 @@
 
 #include "fmod.hpp"
 #include "fmod_errors.h"
+#include "analysis_arena.hpp"
+#include "beat.hpp"
+#include "spectrum_filter.hpp"
+#include "latency.hpp"
+#include "headless.hpp"
+#include "profiler.hpp"
 
-void InitFMOD(int res);
+// most streams played at once, and most channels analysed across all of them (two 7.1 streams):
+#define MAX_STREAMS             4
+#define ANALYSIS_MAX_CHANNELS   16
+// samples per FFT window (the DSP reports half as many bins):
+#define FFT_WINDOW              2048
+// longest spectrum freq_analysis() will make (the arena is reserved this big up front):
+#define ANALYSIS_MAX_RES        (FFT_WINDOW / 2)
+
+void InitFMOD(int res, int numFiles, char **files);
 float** freq_analysis(int res);
 void switchPaused();
 
+int spectrumChannels();
+float* spectrumChannel(int channel);
+float* peakChannel(int channel);
+int streamCount();
+int streamFirstChannel(int stream);
+int streamChannels(int stream);
+int channelStream(int channel);
+float audioTime();
+float speakerTime();
+float contentTime();
+float visualTime();
+
 void ERRCHECK_fn(FMOD_RESULT result, const char *file, int line);
 #define ERRCHECK(_result) ERRCHECK_fn(_result, __FILE__, __LINE__)
 
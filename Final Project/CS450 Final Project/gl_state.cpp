@@ -0,0 +1,220 @@
+//
+//  gl_state.cpp
+//  CS450 Final Project
+//
+//  A shadow of the fixed function state the frame sets over and over (enables,
+//  shade model, blending, depth writes, fog, materials, lights), so a call that
+//  would set what is already set never reaches the driver. Each call counts as issued
+//  or suppressed for the profiler. Everything starts unknown, so the first call
+//  of each kind always goes through; code that changes this state behind the
+//  cache's back must call invalidateStateCache() (glPush/PopAttrib pairs are
+//  fine, as they put back what the cache saw).
+//
+//  Not cached: light positions and spot directions (GL transforms them by
+//  the modelview at the time of the call), and material ambient and diffuse
+//  (with GL_COLOR_MATERIAL on, every glColor changes them).
+//
+
+#include "gl_state.hpp"
+
+// capabilities the cache shadows, then one per light:
+#define STATE_CAPS          (8 + STATE_LIGHTS)
+#define STATE_FOG_PARAMS    5
+#define STATE_MATERIAL_PARAMS 3
+#define STATE_LIGHT_PARAMS  8
+
+typedef struct {
+    bool known;
+    GLfloat v[4];
+} StateValue;
+
+bool        StateCacheOn;
+
+signed char stateCaps[STATE_CAPS];                      // 1 on, 0 off, -1 unknown
+GLenum      stateShade, stateBlendSrc, stateBlendDst;   // 0 when unknown
+GLint       stateTexEnv;
+GLfloat     statePoint;
+signed char stateDepthWrite;                            // as stateCaps
+StateValue  stateFog[STATE_FOG_PARAMS];
+StateValue  stateMaterial[2][STATE_MATERIAL_PARAMS];    // front, back
+StateValue  stateLight[STATE_LIGHTS][STATE_LIGHT_PARAMS];
+
+void InitStateCache() {
+    StateCacheOn = true;
+    invalidateStateCache();
+}
+
+// forget everything (the next call of each kind goes through):
+void invalidateStateCache() {
+    memset(stateCaps, -1, sizeof(stateCaps));
+    stateShade = stateBlendSrc = stateBlendDst = 0;
+    stateTexEnv = 0;
+    statePoint = 0;
+    stateDepthWrite = -1;
+    memset(stateFog, 0, sizeof(stateFog));
+    memset(stateMaterial, 0, sizeof(stateMaterial));
+    memset(stateLight, 0, sizeof(stateLight));
+}
+
+// true (and counted as issued) if the call has to reach GL:
+static bool issue(bool redundant) {
+    if (redundant && StateCacheOn) {
+        profileCount(COUNT_STATE_SUPPRESSED, 1);
+        return false;
+    }
+    profileCount(COUNT_STATE_ISSUED, 1);
+    return true;
+}
+
+// records n floats in a slot; true if they have to be sent:
+static bool issueValue(StateValue *slot, const GLfloat *v, int n) {
+    if (slot == NULL) return issue(false);
+    bool redundant = slot->known && memcmp(slot->v, v, n * sizeof(GLfloat)) == 0;
+    slot->known = true;
+    memcpy(slot->v, v, n * sizeof(GLfloat));
+    return issue(redundant);
+}
+
+// MARK: - Capabilities
+
+static int capSlot(GLenum cap) {
+    switch (cap) {
+        case GL_DEPTH_TEST:     return 0;
+        case GL_FOG:            return 1;
+        case GL_LIGHTING:       return 2;
+        case GL_TEXTURE_2D:     return 3;
+        case GL_BLEND:          return 4;
+        case GL_NORMALIZE:      return 5;
+        case GL_POINT_SMOOTH:   return 6;
+        case GL_COLOR_MATERIAL: return 7;
+    }
+    if (cap >= GL_LIGHT0 && cap < GL_LIGHT0 + STATE_LIGHTS) return 8 + (cap - GL_LIGHT0);
+    return -1;
+}
+
+void stateSet(GLenum cap, bool on) {
+    int slot = capSlot(cap);
+    bool redundant = slot >= 0 && stateCaps[slot] == on;
+    if (slot >= 0) stateCaps[slot] = on;
+    if (!issue(redundant)) return;
+
+    if (on) glEnable(cap);
+    else glDisable(cap);
+}
+
+void stateEnable(GLenum cap) {
+    stateSet(cap, true);
+}
+
+void stateDisable(GLenum cap) {
+    stateSet(cap, false);
+}
+
+// MARK: - Single values
+
+void stateShadeModel(GLenum mode) {
+    bool redundant = stateShade == mode;
+    stateShade = mode;
+    if (issue(redundant)) glShadeModel(mode);
+}
+
+void stateBlendFunc(GLenum src, GLenum dst) {
+    bool redundant = stateBlendSrc == src && stateBlendDst == dst;
+    stateBlendSrc = src;
+    stateBlendDst = dst;
+    if (issue(redundant)) glBlendFunc(src, dst);
+}
+
+void stateTexEnvMode(GLint mode) {
+    bool redundant = stateTexEnv == mode;
+    stateTexEnv = mode;
+    if (issue(redundant)) glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, mode);
+}
+
+void statePointSize(GLfloat size) {
+    bool redundant = statePoint == size;
+    statePoint = size;
+    if (issue(redundant)) glPointSize(size);
+}
+
+void stateDepthMask(GLboolean flag) {
+    bool redundant = stateDepthWrite == (flag != GL_FALSE);
+    stateDepthWrite = (flag != GL_FALSE);
+    if (issue(redundant)) glDepthMask(flag);
+}
+
+// MARK: - Fog
+
+static StateValue* fogSlot(GLenum pname) {
+    switch (pname) {
+        case GL_FOG_MODE:       return &stateFog[0];
+        case GL_FOG_DENSITY:    return &stateFog[1];
+        case GL_FOG_START:      return &stateFog[2];
+        case GL_FOG_END:        return &stateFog[3];
+        case GL_FOG_COLOR:      return &stateFog[4];
+    }
+    return NULL;
+}
+
+void stateFogi(GLenum pname, GLint value) {
+    GLfloat v = (GLfloat)value;
+    if (issueValue(fogSlot(pname), &v, 1)) glFogi(pname, value);
+}
+
+void stateFogf(GLenum pname, GLfloat value) {
+    if (issueValue(fogSlot(pname), &value, 1)) glFogf(pname, value);
+}
+
+void stateFogfv(GLenum pname, const GLfloat *value) {
+    if (issueValue(fogSlot(pname), value, (pname == GL_FOG_COLOR) ? 4 : 1)) glFogfv(pname, value);
+}
+
+// MARK: - Materials and lights
+
+static StateValue* materialSlot(GLenum face, GLenum pname) {
+    int f;
+    switch (face) {
+        case GL_FRONT:  f = 0; break;
+        case GL_BACK:   f = 1; break;
+        default:        return NULL;    // (GL_FRONT_AND_BACK: not worth the bookkeeping)
+    }
+    switch (pname) {
+        case GL_EMISSION:   return &stateMaterial[f][0];
+        case GL_SPECULAR:   return &stateMaterial[f][1];
+        case GL_SHININESS:  return &stateMaterial[f][2];
+    }
+    return NULL;
+}
+
+void stateMaterialf(GLenum face, GLenum pname, GLfloat value) {
+    if (issueValue(materialSlot(face, pname), &value, 1)) glMaterialf(face, pname, value);
+}
+
+void stateMaterialfv(GLenum face, GLenum pname, const GLfloat *value) {
+    if (issueValue(materialSlot(face, pname), value, (pname == GL_SHININESS) ? 1 : 4)) glMaterialfv(face, pname, value);
+}
+
+static StateValue* lightSlot(GLenum light, GLenum pname) {
+    if (light < GL_LIGHT0 || light >= GL_LIGHT0 + STATE_LIGHTS) return NULL;
+    StateValue *params = stateLight[light - GL_LIGHT0];
+    switch (pname) {
+        case GL_AMBIENT:                return &params[0];
+        case GL_DIFFUSE:                return &params[1];
+        case GL_SPECULAR:               return &params[2];
+        case GL_SPOT_EXPONENT:          return &params[3];
+        case GL_SPOT_CUTOFF:            return &params[4];
+        case GL_CONSTANT_ATTENUATION:   return &params[5];
+        case GL_LINEAR_ATTENUATION:     return &params[6];
+        case GL_QUADRATIC_ATTENUATION:  return &params[7];
+    }
+    return NULL;
+}
+
+void stateLightf(GLenum light, GLenum pname, GLfloat value) {
+    if (issueValue(lightSlot(light, pname), &value, 1)) glLightf(light, pname, value);
+}
+
+void stateLightfv(GLenum light, GLenum pname, const GLfloat *value) {
+    int n = (pname == GL_AMBIENT || pname == GL_DIFFUSE || pname == GL_SPECULAR) ? 4 : 1;
+    if (issueValue(lightSlot(light, pname), value, n)) glLightfv(light, pname, value);
+}
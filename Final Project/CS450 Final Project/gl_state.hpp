@@ -0,0 +1,51 @@
+//
+//  gl_state.hpp
+//  CS450 Final Project
+//
+
+#ifndef gl_state_hpp
+#define gl_state_hpp
+
+#ifdef WIN32
+#include <windows.h>
+#pragma warning(disable:4996)
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <GL/glu.h>
+#include <GL/glut.h>
+#else
+#include <GLUT/glut.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include "profiler.hpp"
+
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+
+// lights the cache keeps parameters for:
+#define STATE_LIGHTS    8
+
+// off passes every call through (still counted), to compare against:
+extern bool StateCacheOn;
+
+void InitStateCache();
+void invalidateStateCache();
+
+void stateEnable(GLenum cap);
+void stateDisable(GLenum cap);
+void stateSet(GLenum cap, bool on);
+void stateShadeModel(GLenum mode);
+void stateBlendFunc(GLenum src, GLenum dst);
+void stateTexEnvMode(GLint mode);
+void statePointSize(GLfloat size);
+void stateDepthMask(GLboolean flag);
+void stateFogi(GLenum pname, GLint value);
+void stateFogf(GLenum pname, GLfloat value);
+void stateFogfv(GLenum pname, const GLfloat *value);
+void stateMaterialf(GLenum face, GLenum pname, GLfloat value);
+void stateMaterialfv(GLenum face, GLenum pname, const GLfloat *value);
+void stateLightf(GLenum light, GLenum pname, GLfloat value);
+void stateLightfv(GLenum light, GLenum pname, const GLfloat *value);
+
+#endif /* gl_state_hpp */
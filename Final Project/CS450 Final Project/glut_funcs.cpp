@@ -42,14 +42,14 @@ const GLfloat Colors[8][3] = {
     { 1., 1., 1. },		// white
     { 0., 0., 0. },		// black
 };
-GLfloat White[] = {1., 1., 1., 1.};
+const vec4 White(1., 1., 1., 1.);
 
 
 
 
 // non-constant global variables:
 GLuint	AxesList;				// list to hold the axes
-GLuint  texDay, texLight, texMoon;
+TextureHandle texDay, texLight, texMoon;
 
 int		ActiveButton;			// current button that is down
 bool	AxesOn;					// != 0 means to draw the axes
@@ -142,6 +142,7 @@ void DoProjectMenu(int id) {
 
 // use glut to display a string of characters using a raster font:
 void DoRasterString(float x, float y, float z, char const *s) {
+    if (Headless) return; // (GLUT's fonts need glutInit)
     glRasterPos3f( (GLfloat)x, (GLfloat)y, (GLfloat)z );
     
     char c;			// one character to print
@@ -152,6 +153,7 @@ void DoRasterString(float x, float y, float z, char const *s) {
 
 // use glut to display a string of characters using a stroke font:
 void DoStrokeString(float x, float y, float z, float ht, char const *s) {
+    if (Headless) return;
     glPushMatrix();
     glTranslatef( (GLfloat)x, (GLfloat)y, (GLfloat)z );
     float sf = ht / (119.05f + 33.33f);
@@ -248,18 +250,18 @@ void Resize(int width, int height) {
     glMatrixMode(GL_MODELVIEW);
     glLoadIdentity();
     gluLookAt(0, 1, 3, 0, 1, 0, 0, 1, 0);
-    glFogfv(GL_FOG_COLOR, black);
-    glFogf(GL_FOG_START, 2.5);
-    glFogf(GL_FOG_END, 4);
-    glEnable(GL_FOG);
-    glFogi(GL_FOG_MODE, GL_LINEAR);
+    stateFogfv(GL_FOG_COLOR, black);
+    stateFogf(GL_FOG_START, 2.5);
+    stateFogf(GL_FOG_END, 4);
+    stateEnable(GL_FOG);
+    stateFogi(GL_FOG_MODE, GL_LINEAR);
 //    glPointSize(point_size);
-    glEnable(GL_POINT_SMOOTH);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glEnable(GL_COLOR_MATERIAL);
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_LIGHT0);
+    stateEnable(GL_POINT_SMOOTH);
+    stateEnable(GL_BLEND);
+    stateBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    stateEnable(GL_COLOR_MATERIAL);
+    stateEnable(GL_DEPTH_TEST);
+    stateEnable(GL_LIGHT0);
     
     glutSetWindow(MainWindow);
     glutPostRedisplay();
@@ -269,6 +271,8 @@ void Resize(int width, int height) {
 void Visibility(int state) {
     if (DebugOn)
         fprintf(stderr, "Visibility: %d\n", state);
+    // nothing to see, so nothing to simulate either
+    SimulationPaused = (state != GLUT_VISIBLE) || Frozen;
     if (state == GLUT_VISIBLE) {
         glutIdleFunc(AnimateFunc);
     } else {
@@ -276,10 +280,15 @@ void Visibility(int state) {
     }
 }
 
+// milliseconds since the start of the program (on the frame clock when headless):
+int ElapsedMs() {
+    return HeadlessElapsedMs();
+}
+
 // return the number of seconds since the start of the program:
 float ElapsedSeconds() {
     // get # of milliseconds since the start of the program:
-    int ms = glutGet(GLUT_ELAPSED_TIME);
+    int ms = ElapsedMs();
     
     // convert it to seconds:
     return (float)ms / 1000.f;
@@ -385,42 +394,42 @@ void Axes(float length) {
 // MARK: - Lighting
 
 void SetMaterial(float r, float g, float b,  float shininess) {
-    glMaterialfv( GL_BACK, GL_EMISSION, Array3( 0., 0., 0. ) );
-    glMaterialfv( GL_BACK, GL_AMBIENT, MulArray3( .4f, White ) );
-    glMaterialfv( GL_BACK, GL_DIFFUSE, MulArray3( 1., White ) );
-    glMaterialfv( GL_BACK, GL_SPECULAR, Array3( 0., 0., 0. ) );
-    glMaterialf ( GL_BACK, GL_SHININESS, 5.f );
+    stateMaterialfv( GL_BACK, GL_EMISSION, vec4( 0., 0., 0., 1. ) );
+    stateMaterialfv( GL_BACK, GL_AMBIENT, vec4( .4f * White.xyz(), 1. ) );
+    stateMaterialfv( GL_BACK, GL_DIFFUSE, White );
+    stateMaterialfv( GL_BACK, GL_SPECULAR, vec4( 0., 0., 0., 1. ) );
+    stateMaterialf ( GL_BACK, GL_SHININESS, 5.f );
     
-    glMaterialfv( GL_FRONT, GL_EMISSION, Array3( 0., 0., 0. ) );
-    glMaterialfv( GL_FRONT, GL_AMBIENT, Array3( r, g, b ) );
-    glMaterialfv( GL_FRONT, GL_DIFFUSE, Array3( r, g, b ) );
-    glMaterialfv( GL_FRONT, GL_SPECULAR, MulArray3( .8f, White ) );
-    glMaterialf ( GL_FRONT, GL_SHININESS, shininess );
+    stateMaterialfv( GL_FRONT, GL_EMISSION, vec4( 0., 0., 0., 1. ) );
+    stateMaterialfv( GL_FRONT, GL_AMBIENT, vec4( r, g, b, 1. ) );
+    stateMaterialfv( GL_FRONT, GL_DIFFUSE, vec4( r, g, b, 1. ) );
+    stateMaterialfv( GL_FRONT, GL_SPECULAR, vec4( .8f * White.xyz(), 1. ) );
+    stateMaterialf ( GL_FRONT, GL_SHININESS, shininess );
 }
 
 
 void SetPointLight(int ilight, float x, float y, float z,  float r, float g, float b) {
-    glLightfv( ilight, GL_POSITION,  Array3( x, y, z ) );
-    glLightfv( ilight, GL_AMBIENT,   Array3( 0., 0., 0. ) );
-    glLightfv( ilight, GL_DIFFUSE,   Array3( r, g, b ) );
-    glLightfv( ilight, GL_SPECULAR,  Array3( r, g, b ) );
-    glLightf ( ilight, GL_CONSTANT_ATTENUATION, 1. );
-    glLightf ( ilight, GL_LINEAR_ATTENUATION, 0. );
-    glLightf ( ilight, GL_QUADRATIC_ATTENUATION, 0. );
-    glEnable( ilight );
+    stateLightfv( ilight, GL_POSITION,  vec4( x, y, z, 1. ) );
+    stateLightfv( ilight, GL_AMBIENT,   vec4( 0., 0., 0., 1. ) );
+    stateLightfv( ilight, GL_DIFFUSE,   vec4( r, g, b, 1. ) );
+    stateLightfv( ilight, GL_SPECULAR,  vec4( r, g, b, 1. ) );
+    stateLightf ( ilight, GL_CONSTANT_ATTENUATION, 1. );
+    stateLightf ( ilight, GL_LINEAR_ATTENUATION, 0. );
+    stateLightf ( ilight, GL_QUADRATIC_ATTENUATION, 0. );
+    stateEnable( ilight );
 }
 
 
 void SetSpotLight(int ilight, float x, float y, float z,  float xdir, float ydir, float zdir, float r, float g, float b) {
-    glLightfv( ilight, GL_POSITION,  Array3( x, y, z ) );
-    glLightfv( ilight, GL_SPOT_DIRECTION,  Array3(xdir,ydir,zdir) );
-    glLightf(  ilight, GL_SPOT_EXPONENT, 1. );
-    glLightf(  ilight, GL_SPOT_CUTOFF, 45. );
-    glLightfv( ilight, GL_AMBIENT,   Array3( 0., 0., 0. ) );
-    glLightfv( ilight, GL_DIFFUSE,   Array3( r, g, b ) );
-    glLightfv( ilight, GL_SPECULAR,  Array3( r, g, b ) );
-    glLightf ( ilight, GL_CONSTANT_ATTENUATION, 1. );
-    glLightf ( ilight, GL_LINEAR_ATTENUATION, 0. );
-    glLightf ( ilight, GL_QUADRATIC_ATTENUATION, 0. );
-    glEnable( ilight );
+    stateLightfv( ilight, GL_POSITION,  vec4( x, y, z, 1. ) );
+    stateLightfv( ilight, GL_SPOT_DIRECTION,  vec4(xdir,ydir,zdir,1.) );
+    stateLightf(  ilight, GL_SPOT_EXPONENT, 1. );
+    stateLightf(  ilight, GL_SPOT_CUTOFF, 45. );
+    stateLightfv( ilight, GL_AMBIENT,   vec4( 0., 0., 0., 1. ) );
+    stateLightfv( ilight, GL_DIFFUSE,   vec4( r, g, b, 1. ) );
+    stateLightfv( ilight, GL_SPECULAR,  vec4( r, g, b, 1. ) );
+    stateLightf ( ilight, GL_CONSTANT_ATTENUATION, 1. );
+    stateLightf ( ilight, GL_LINEAR_ATTENUATION, 0. );
+    stateLightf ( ilight, GL_QUADRATIC_ATTENUATION, 0. );
+    stateEnable( ilight );
 }
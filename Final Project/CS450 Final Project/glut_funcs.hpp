@@ -23,6 +23,10 @@
 #include <stdio.h>
 #include <cstdlib>
 #include "utility_funcs.hpp"
+#include "texture_manager.hpp"
+#include "headless.hpp"
+#include "scheduler.hpp"
+#include "gl_state.hpp"
 
 #pragma GCC diagnostic ignored "-Wdeprecated-declarations"
 
@@ -69,7 +73,7 @@ enum Colors {
     WHITE,
     BLACK
 };
-extern GLfloat White[];
+extern const vec4 White;
 extern const GLfloat Colors[8][3];
 extern char const* ColorNames[];
 
@@ -81,7 +85,7 @@ extern bool     TextureOn;              // show texture or not
 extern bool     DayMode;
 extern bool		DebugOn;				// != 0 means to print debugging info
 extern bool		DepthCueOn;				// != 0 means to use intensity depth cueing
-extern GLuint   texDay, texLight, texMoon;
+extern TextureHandle texDay, texLight, texMoon;  // managed textures
 extern int		MainWindow;				// window id for main graphics window
 extern float	Scale;					// scaling factor
 extern int		WhichColor;				// index into Colors[ ]
@@ -107,10 +111,12 @@ void	DoProjectMenu(int);
 void	DoRasterString(float, float, float, char const *);
 void	DoStrokeString(float, float, float, float, char const *);
 
+int	ElapsedMs();
 float	ElapsedSeconds();
 void	InitGraphics();
 void    InitTextures();
 void	InitLists();
+void    InitMaterials();
 void	InitMenus();
 void	Keyboard(unsigned char, int, int);
 void	MouseButton(int, int, int, int);
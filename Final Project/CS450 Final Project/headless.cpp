@@ -0,0 +1,279 @@
+//
+//  headless.cpp
+//  CS450 Final Project
+//
+//  Rendering with no window or display server, for batch renders and image
+//  regression tests. The GL context is offscreen (CGL on the Mac, EGL on Mesa's
+//  surfaceless platform elsewhere, which the llvmpipe software rasteriser runs
+//  on), the scene is drawn into a framebuffer object, and each frame is read
+//  back and written out as a binary PPM. The output is one of:
+//      frames/%05d.ppm     a file per frame (any printf pattern with the frame number)
+//      |command            frames piped back to back into an encoder, e.g.
+//                          "|ffmpeg -f image2pipe -c:v ppm -r 60 -i - out.mp4"
+//      file                frames back to back in one file
+//
+//  Nothing here knows about the visualizer, so any of the GLUT mains can render
+//  headless: strip the arguments with HeadlessArgs() before glutInit() (and
+//  skip glutInit() and the window when it returns true), call InitHeadless() in
+//  place of creating the window, swap with HeadlessSwapBuffers(), size the
+//  viewport from HeadlessWindowSize(), animate on HeadlessElapsedMs(), and hand
+//  Animate() and Display() to HeadlessRun() in place of glutMainLoop().
+//
+
+#include "headless.hpp"
+
+#if defined(__APPLE__)
+#include <OpenGL/OpenGL.h>
+#include <OpenGL/glext.h>
+#define HEADLESS_CGL
+#elif !defined(WIN32)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#define HEADLESS_EGL
+#else
+#define popen   _popen
+#define pclose  _pclose
+#endif
+
+bool            Headless = false;
+int             HeadlessWidth, HeadlessHeight;
+int             HeadlessFrame = 0, HeadlessFrames = 0;
+const char      *HeadlessOutput = NULL;
+
+#ifdef HEADLESS_CGL
+CGLContextObj   headlessContext = NULL;
+#endif
+#ifdef HEADLESS_EGL
+EGLDisplay      headlessDisplay = EGL_NO_DISPLAY;
+EGLContext      headlessContext = EGL_NO_CONTEXT;
+#endif
+
+GLuint          headlessFbo = 0, headlessColor = 0, headlessDepth = 0;
+FILE            *headlessOut = NULL;
+bool            headlessPipe = false;
+const char      *headlessPattern = NULL;    // set for a file per frame
+std::vector<unsigned char> headlessPixels;
+
+void cleanHeadless() {
+    puts("Cleaning headless resources");
+
+    if (headlessOut != NULL) {
+        if (headlessPipe) pclose(headlessOut);
+        else fclose(headlessOut);
+    }
+#ifdef GL_FRAMEBUFFER_EXT
+    if (headlessFbo != 0) {
+        glDeleteFramebuffersEXT(1, &headlessFbo);
+        glDeleteRenderbuffersEXT(1, &headlessColor);
+        glDeleteRenderbuffersEXT(1, &headlessDepth);
+    }
+#endif
+#ifdef HEADLESS_CGL
+    if (headlessContext != NULL) {
+        CGLSetCurrentContext(NULL);
+        CGLDestroyContext(headlessContext);
+    }
+#endif
+#ifdef HEADLESS_EGL
+    if (headlessDisplay != EGL_NO_DISPLAY) {
+        eglMakeCurrent(headlessDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (headlessContext != EGL_NO_CONTEXT) eglDestroyContext(headlessDisplay, headlessContext);
+        eglTerminate(headlessDisplay);
+    }
+#endif
+}
+
+// a legacy (fixed function) context with nothing to draw on, made current:
+static bool createContext() {
+#if defined(HEADLESS_CGL)
+    // no kCGLPFAAccelerated: with no GPU about, Apple's software renderer will do
+    CGLPixelFormatAttribute attribs[] = {
+        kCGLPFAColorSize, (CGLPixelFormatAttribute)24,
+        kCGLPFADepthSize, (CGLPixelFormatAttribute)24,
+        kCGLPFAAllowOfflineRenderers,
+        (CGLPixelFormatAttribute)0
+    };
+    CGLPixelFormatObj format = NULL;
+    GLint formats;
+    if (CGLChoosePixelFormat(attribs, &format, &formats) != kCGLNoError || format == NULL) return false;
+    CGLError err = CGLCreateContext(format, NULL, &headlessContext);
+    CGLDestroyPixelFormat(format);
+    return err == kCGLNoError && CGLSetCurrentContext(headlessContext) == kCGLNoError;
+#elif defined(HEADLESS_EGL)
+    // Mesa's surfaceless platform needs no X or Wayland; failing that, the default display
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay != NULL)
+        headlessDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+#endif
+    if (headlessDisplay == EGL_NO_DISPLAY) headlessDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (headlessDisplay == EGL_NO_DISPLAY || !eglInitialize(headlessDisplay, NULL, NULL)) {
+        headlessDisplay = EGL_NO_DISPLAY;
+        return false;
+    }
+
+    // any desktop GL config: the framebuffer object is what gets drawn on
+    EGLint attribs[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_SURFACE_TYPE, 0, EGL_NONE };
+    EGLConfig config;
+    EGLint configs;
+    if (!eglChooseConfig(headlessDisplay, attribs, &config, 1, &configs) || configs == 0) return false;
+    if (!eglBindAPI(EGL_OPENGL_API)) return false;
+    headlessContext = eglCreateContext(headlessDisplay, config, EGL_NO_CONTEXT, NULL);
+    if (headlessContext == EGL_NO_CONTEXT) return false;
+    return eglMakeCurrent(headlessDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, headlessContext);
+#else
+    return false;
+#endif
+}
+
+// colour and depth renderbuffers standing in for the window's back buffer:
+static bool createFramebuffer(int width, int height) {
+#ifdef GL_FRAMEBUFFER_EXT
+    glGenFramebuffersEXT(1, &headlessFbo);
+    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, headlessFbo);
+
+    glGenRenderbuffersEXT(1, &headlessColor);
+    glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, headlessColor);
+    glRenderbufferStorageEXT(GL_RENDERBUFFER_EXT, GL_RGBA8, width, height);
+    glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_RENDERBUFFER_EXT, headlessColor);
+
+    glGenRenderbuffersEXT(1, &headlessDepth);
+    glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, headlessDepth);
+    glRenderbufferStorageEXT(GL_RENDERBUFFER_EXT, GL_DEPTH_COMPONENT24, width, height);
+    glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_DEPTH_ATTACHMENT_EXT, GL_RENDERBUFFER_EXT, headlessDepth);
+
+    if (glCheckFramebufferStatusEXT(GL_FRAMEBUFFER_EXT) != GL_FRAMEBUFFER_COMPLETE_EXT) return false;
+    glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT);
+    glReadBuffer(GL_COLOR_ATTACHMENT0_EXT);
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ ** takes "-headless frames output" off the front of the arguments, leaving
+ ** the program name and the rest where they were; true if it was there
+ **/
+bool HeadlessArgs(int *argc, char ***argv) {
+    if (*argc < 4 || strcmp((*argv)[1], "-headless") != 0) return false;
+
+    Headless = true;
+    HeadlessFrames = atoi((*argv)[2]);
+    HeadlessOutput = (*argv)[3];
+    (*argv)[3] = (*argv)[0];
+    *argc -= 3;
+    *argv += 3;
+    return true;
+}
+
+// true if pattern takes the frame number as its one and only printf argument:
+static bool framePattern(const char *pattern) {
+    int conversions = 0;
+    for (const char *c = pattern; *c != '\0'; c++) {
+        if (*c != '%') continue;
+        if (*++c == '%') continue;
+        c += strspn(c, "-+ #0");
+        c += strspn(c, "0123456789");
+        if (*c == '.') {
+            c++;
+            c += strspn(c, "0123456789");
+        }
+        if (*c == '\0' || strchr("diouxX", *c) == NULL) return false;
+        conversions++;
+    }
+    return conversions == 1;
+}
+
+/**
+ ** sets up rendering of width x height frames to output (see the top of the
+ ** file) in place of the GLUT window; false if there is no offscreen GL here
+ ** or the output cannot be opened
+ **/
+bool InitHeadless(int width, int height, const char *output) {
+    Headless = true;
+    HeadlessWidth = width;
+    HeadlessHeight = height;
+    headlessPixels.resize((size_t)width * height * 3);
+    atexit(cleanHeadless);
+
+    if (!createContext()) {
+        fprintf(stderr, "Cannot create an offscreen GL context\n");
+        return false;
+    }
+    if (!createFramebuffer(width, height)) {
+        fprintf(stderr, "Cannot create a %dx%d framebuffer object\n", width, height);
+        return false;
+    }
+    fprintf(stderr, "Headless: %s, %dx%d\n", (const char*)glGetString(GL_RENDERER), width, height);
+
+    if (output[0] == '|') {
+        headlessOut = popen(output + 1, "w");
+        headlessPipe = true;
+    } else if (strchr(output, '%') != NULL) {
+        if (!framePattern(output)) {
+            fprintf(stderr, "'%s' needs exactly one integer conversion (like %%05d) for the frame number\n", output);
+            return false;
+        }
+        headlessPattern = output;
+    } else
+        headlessOut = fopen(output, "wb");
+    if (headlessPattern == NULL && headlessOut == NULL) {
+        fprintf(stderr, "Cannot open '%s' for the frames\n", output);
+        return false;
+    }
+    return true;
+}
+
+// in place of the buffer swap: read the frame back and write it out
+void HeadlessPresent() {
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, HeadlessWidth, HeadlessHeight, GL_RGB, GL_UNSIGNED_BYTE, &headlessPixels[0]);
+
+    FILE *fp = headlessOut;
+    if (headlessPattern != NULL) {
+        char filename[1024];
+        snprintf(filename, sizeof(filename), headlessPattern, HeadlessFrame);
+        fp = fopen(filename, "wb");
+        if (fp == NULL) {
+            fprintf(stderr, "Cannot write frame '%s'\n", filename);
+            return;
+        }
+    }
+
+    // PPM rows run top down, GL's bottom up
+    size_t row = (size_t)HeadlessWidth * 3;
+    fprintf(fp, "P6\n%d %d\n255\n", HeadlessWidth, HeadlessHeight);
+    for (int y = HeadlessHeight - 1; y >= 0; y--)
+        fwrite(&headlessPixels[y * row], 1, row, fp);
+
+    if (headlessPattern != NULL) fclose(fp);
+}
+
+// draws frames one after another on the frame clock, then returns for main to return:
+int HeadlessRun(void (*animate)(), void (*display)()) {
+    for (HeadlessFrame = 0; HeadlessFrame < HeadlessFrames; HeadlessFrame++) {
+        animate();
+        display();
+    }
+    return 0;
+}
+
+// in place of glutSwapBuffers():
+void HeadlessSwapBuffers() {
+    if (Headless) HeadlessPresent();
+    else glutSwapBuffers();
+}
+
+// in place of glutGet(GLUT_WINDOW_WIDTH / GLUT_WINDOW_HEIGHT):
+void HeadlessWindowSize(int *width, int *height) {
+    *width = Headless ? HeadlessWidth : glutGet(GLUT_WINDOW_WIDTH);
+    *height = Headless ? HeadlessHeight : glutGet(GLUT_WINDOW_HEIGHT);
+}
+
+// in place of glutGet(GLUT_ELAPSED_TIME): headless, time steps a frame at a time
+int HeadlessElapsedMs() {
+    if (Headless) return (int)((long long)HeadlessFrame * 1000 / HEADLESS_FPS);
+    return glutGet(GLUT_ELAPSED_TIME);
+}
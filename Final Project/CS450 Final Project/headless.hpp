@@ -0,0 +1,47 @@
+//
+//  headless.hpp
+//  CS450 Final Project
+//
+
+#ifndef headless_hpp
+#define headless_hpp
+
+#ifdef WIN32
+#include <windows.h>
+#pragma warning(disable:4996)
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <GL/glu.h>
+#include <GL/glut.h>
+#else
+#include <GLUT/glut.h>
+#endif
+
+#include <stdio.h>
+#include <cstdlib>
+#include <string.h>
+#include <vector>
+
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+
+// the clock steps a frame at this rate, however long the frames take to render:
+#define HEADLESS_FPS            60
+// the audio is mixed at this rate, a frame's worth of samples per frame:
+#define HEADLESS_SAMPLE_RATE    48000
+
+extern bool Headless;
+extern int HeadlessWidth, HeadlessHeight;
+extern int HeadlessFrame, HeadlessFrames;
+extern const char *HeadlessOutput;
+
+bool HeadlessArgs(int *argc, char ***argv);
+bool InitHeadless(int width, int height, const char *output);
+int HeadlessRun(void (*animate)(), void (*display)());
+void HeadlessPresent();
+
+// stand-ins for the GLUT calls a main makes, good with or without a window:
+void HeadlessSwapBuffers();
+void HeadlessWindowSize(int *width, int *height);
+int HeadlessElapsedMs();
+
+#endif /* headless_hpp */
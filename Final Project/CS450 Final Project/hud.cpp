@@ -0,0 +1,180 @@
+//
+//  hud.cpp
+//  CS450 Final Project
+//
+//  Performance overlay, drawn in one pass at the end of the frame. Every glyph
+//  is compiled into a display list once. Lines are padded to the same width,
+//  and '\n' is a list that moves the raster position back and down a line, so
+//  the whole block of text is a single glCallLists(). The backdrop, the frame
+//  time bars and the budget lines are all quads in one vertex array, so they
+//  are a single glDrawArrays().
+//
+
+#include "hud.hpp"
+#include "palette.hpp"
+
+// quads: the backdrop, a bar per frame and the two budget lines
+#define HUD_QUADS   (1 + HUD_GRAPH_WIDTH + 2)
+
+// bars go green, then yellow past 60 fps, then red past 30 fps:
+constexpr ColorStop hudStops[] = { {0., .2, .85, .3}, {.33, .2, .85, .3}, {.34, .95, .8, .2},
+                                   {.66, .95, .8, .2}, {.67, .95, .25, .2}, {1., .95, .25, .2} };
+constexpr ColorLut<64> HudBarLut = GradientLut<64>(hudStops, 220);
+
+bool            HudOn;
+
+GLuint          hudFont = 0;                                    // list base, one per ASCII code
+char            hudText[HUD_MAX_LINES * (HUD_LINE_CHARS + 1)];  // padded lines, '\n' after each
+int             hudLines = 0;
+GLfloat         hudVerts[4 * HUD_QUADS][2];
+GLubyte         hudColors[4 * HUD_QUADS][4];
+int             hudQuads = 0;
+
+void cleanHud() {
+    puts("Cleaning HUD resources");
+
+    if (hudFont != 0) glDeleteLists(hudFont, 128);
+}
+
+// needs the GL context (the font goes into display lists):
+void InitHud() {
+    HudOn = false;
+
+    hudFont = glGenLists(128);
+    for (int c = ' '; c < 127; c++) {
+        glNewList(hudFont + c, GL_COMPILE);
+        glutBitmapCharacter(HUD_FONT, c);
+        glEndList();
+    }
+    // back to the start of the line and down one (an empty bitmap, though some
+    // drivers will not compile a NULL one into a list)
+    const GLubyte none = 0;
+    glNewList(hudFont + '\n', GL_COMPILE);
+    glBitmap(0, 0, 0., 0., -HUD_LINE_CHARS * HUD_CHAR_WIDTH, -HUD_LINE_HEIGHT, &none);
+    glEndList();
+
+    atexit(cleanHud);
+}
+
+// add a line of text, cut or padded to HUD_LINE_CHARS:
+void hudPrintf(const char *format, ...) {
+    if (hudLines == HUD_MAX_LINES) return;
+
+    char line[HUD_LINE_CHARS + 1];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+
+    char *dst = &hudText[hudLines++ * (HUD_LINE_CHARS + 1)];
+    size_t len = strlen(line);
+    memcpy(dst, line, len);
+    memset(dst + len, ' ', HUD_LINE_CHARS - len);
+    dst[HUD_LINE_CHARS] = '\n';
+}
+
+void hudQuad(float x0, float y0, float x1, float y1, const GLubyte *rgba) {
+    GLfloat corners[4][2] = { {x0, y0}, {x1, y0}, {x1, y1}, {x0, y1} };
+    for (int i = 0; i < 4; i++) {
+        memcpy(hudVerts[4 * hudQuads + i], corners[i], sizeof(corners[i]));
+        memcpy(hudColors[4 * hudQuads + i], rgba, 4);
+    }
+    hudQuads++;
+}
+
+// fps, the stages and the counts from the profiler, and the A/V latency:
+void hudGather() {
+    hudLines = 0;
+
+    ProfileStats frame = profileFrameStats();
+    hudPrintf("%5.1f fps   %5.2f ms avg   %5.2f ms p99", (frame.avg > 0) ? 1000. / frame.avg : 0., frame.avg, frame.p99);
+    hudPrintf("particles        %d", profileCounter(COUNT_PARTICLES));
+    hudPrintf("sphere vertices  %d", profileCounter(COUNT_SPHERE_VERTICES));
+    hudPrintf("draw calls       %d", profileCounter(COUNT_DRAW_CALLS));
+    hudPrintf("state calls      %d (%d suppressed)", profileCounter(COUNT_STATE_ISSUED), profileCounter(COUNT_STATE_SUPPRESSED));
+    hudPrintf("material changes %d", profileCounter(COUNT_MATERIAL_CHANGES));
+    hudPrintf("A/V latency      %.0f ms (p99 %.0f ms)", 1000 * latencyPercentile(.5f), 1000 * latencyPercentile(.99f));
+    hudPrintf("");
+
+    for (int z = 0; z < profileZoneCount(); z++) {
+        if (profileZoneDepth(z) != 0) continue;
+        ProfileStats cpu = profileCpuStats(z);
+        ProfileStats gpu = profileGpuStats(z);
+        if (gpu.samples)
+            hudPrintf("%-12s cpu %5.2f  gpu %5.2f ms", profileZoneName(z), cpu.avg, gpu.avg);
+        else
+            hudPrintf("%-12s cpu %5.2f ms", profileZoneName(z), cpu.avg);
+    }
+}
+
+/**
+ ** the overlay in the top left of the window: text over the frame time graph
+ ** (a bar per frame across the profiler's window, lines at 60 and 30 fps)
+ **/
+void DrawHud() {
+    if (!HudOn) return;
+    PROFILE_ZONE("HUD");
+
+    hudGather();
+
+    int w = glutGet(GLUT_WINDOW_WIDTH);
+    int h = glutGet(GLUT_WINDOW_HEIGHT);
+    const int pad = 6;
+    float left = 10, top = h - 10;
+    float right = left + 2*pad + HUD_LINE_CHARS * HUD_CHAR_WIDTH;
+    float graphTop = top - pad - hudLines * HUD_LINE_HEIGHT - pad;
+    float graphBottom = graphTop - HUD_GRAPH_HEIGHT;
+    float graphLeft = left + pad;
+
+    hudQuads = 0;
+    const GLubyte backdrop[4] = { 0, 0, 0, 160 };
+    hudQuad(left, graphBottom - pad, right, top, backdrop);
+    for (int i = 0; i < HUD_GRAPH_WIDTH; i++) {
+        float ms = profileFrameTime(HUD_GRAPH_WIDTH - 1 - i);     // oldest on the left
+        float t = std::min(ms / HUD_GRAPH_MS, 1.f);
+        if (t > 0) hudQuad(graphLeft + i, graphBottom, graphLeft + i + 1, graphBottom + t * HUD_GRAPH_HEIGHT, HudBarLut(t));
+    }
+    const GLubyte budget[4] = { 255, 255, 255, 90 };
+    for (float ms = 1000.f / 60; ms < 1000.f / 29; ms *= 2) {
+        float y = graphBottom + ms / HUD_GRAPH_MS * HUD_GRAPH_HEIGHT;
+        hudQuad(graphLeft, y, graphLeft + HUD_GRAPH_WIDTH, y + 1, budget);
+    }
+
+    glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT | GL_VIEWPORT_BIT | GL_LIST_BIT | GL_COLOR_BUFFER_BIT);
+    glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+    glDisable(GL_LIGHTING);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_TEXTURE_2D);
+    glDisable(GL_FOG);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    // pixel coordinates over the whole window
+    glViewport(0, 0, w, h);
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    gluOrtho2D(0., w, 0., h);
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(2, GL_FLOAT, 0, hudVerts);
+    glColorPointer(4, GL_UNSIGNED_BYTE, 0, hudColors);
+    glDrawArrays(GL_QUADS, 0, 4 * hudQuads);
+
+    glColor3f(1., 1., 1.);
+    glRasterPos2f(left + pad, top - pad - (HUD_LINE_HEIGHT - 2));
+    glListBase(hudFont);
+    glCallLists(hudLines * (HUD_LINE_CHARS + 1), GL_UNSIGNED_BYTE, hudText);
+    profileCount(COUNT_DRAW_CALLS, 2);
+
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glPopClientAttrib();
+    glPopAttrib();
+}
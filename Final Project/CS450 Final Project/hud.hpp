@@ -0,0 +1,46 @@
+//
+//  hud.hpp
+//  CS450 Final Project
+//
+
+#ifndef hud_hpp
+#define hud_hpp
+
+#ifdef WIN32
+#include <windows.h>
+#pragma warning(disable:4996)
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <GL/glu.h>
+#include <GL/glut.h>
+#else
+#include <GLUT/glut.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <algorithm>
+#include "profiler.hpp"
+#include "latency.hpp"
+
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+
+// the HUD font (a fixed width GLUT bitmap font) and its cell in pixels:
+#define HUD_FONT            GLUT_BITMAP_8_BY_13
+#define HUD_CHAR_WIDTH      8
+#define HUD_LINE_HEIGHT     15
+// most text lines, and the longest one:
+#define HUD_MAX_LINES       24
+#define HUD_LINE_CHARS      48
+// frame time graph (pixels), and the ms at its top:
+#define HUD_GRAPH_WIDTH     PROFILE_WINDOW
+#define HUD_GRAPH_HEIGHT    60
+#define HUD_GRAPH_MS        50.f
+
+extern bool HudOn;
+
+void InitHud();
+void DrawHud();
+
+#endif /* hud_hpp */
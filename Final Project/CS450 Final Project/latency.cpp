@@ -0,0 +1,116 @@
+//
+//  latency.cpp
+//  CS450 Final Project
+//
+//  Times here are all on the audio clock, in seconds:
+//    content time -- the moment of the song an analysed spectrum describes
+//    speaker time -- the moment of the song currently coming out of the speakers
+//  A presented frame's latency is speaker time at present minus the content
+//  time of the spectrum it showed (positive means the visuals lag the audio).
+//
+
+#include "latency.hpp"
+
+bool    LatencyCompensationOn;
+float   LatencyTrim;
+
+typedef struct {
+    float contentTime;
+    int channels;
+} HistoryFrame;
+
+HistoryFrame    history[LATENCY_FRAMES];    // ring of analysed frames (rows live in the arena)
+int             historyHead = 0;
+int             historyCount = 0;
+int             historyChannels = 0;        // arena rows per frame
+float           shownContentTime = -1;      // content time of the spectrum handed out last
+
+float           samples[LATENCY_SAMPLES];   // ring of per-frame latency measurements
+int             sampleHead = 0;
+int             sampleCount = 0;
+float           lastPresent = -1;
+
+// history frames get their own rows in the arena, frame after frame:
+void InitLatency(int channels, int res) {
+    historyChannels = channels;
+    arenaReserve(ARENA_HISTORY, LATENCY_FRAMES * channels, res);
+    LatencyCompensationOn = true;
+    LatencyTrim = 0;
+}
+
+static float** historyRows(int frame) {
+    return arenaStage(ARENA_HISTORY) + frame * historyChannels;
+}
+
+// keep a copy of a freshly analysed spectrum along with the moment it describes:
+void recordAnalysisFrame(float **spec, int channels, int res, float contentTime) {
+    if (channels > historyChannels) channels = historyChannels;
+
+    // a new resolution (or a jump back in the song) invalidates the history
+    bool resized = (arenaLength(ARENA_HISTORY) != res);
+    if (resized && !arenaResize(ARENA_HISTORY, res)) return;
+    int newest = (historyHead + LATENCY_FRAMES - 1) % LATENCY_FRAMES;
+    if (resized || (historyCount && contentTime < history[newest].contentTime))
+        historyCount = 0;
+
+    float **rows = historyRows(historyHead);
+    for (int c = 0; c < channels; c++)
+        memcpy(rows[c], spec[c], res * sizeof(float));
+    history[historyHead].contentTime = contentTime;
+    history[historyHead].channels = channels;
+
+    historyHead = (historyHead + 1) % LATENCY_FRAMES;
+    if (historyCount < LATENCY_FRAMES) historyCount++;
+}
+
+// spectrum to show now: the stored frame whose content is closest to what the
+// speakers are playing (can only go back as far as the history, and no later
+// than the newest analysis)
+float** lookupSpectrum(float speakerTime, int *channels) {
+    if (historyCount == 0) return NULL;
+
+    int newest = (historyHead + LATENCY_FRAMES - 1) % LATENCY_FRAMES;
+    int best = newest;
+    if (LatencyCompensationOn) {
+        float target = speakerTime + LatencyTrim;
+        for (int i = 0; i < historyCount; i++) {
+            int f = (historyHead + LATENCY_FRAMES - 1 - i) % LATENCY_FRAMES;
+            if (fabsf(history[f].contentTime - target) < fabsf(history[best].contentTime - target))
+                best = f;
+        }
+    }
+
+    shownContentTime = history[best].contentTime;
+    *channels = history[best].channels;
+    return historyRows(best);
+}
+
+// call right after the buffer swap, with the speaker time at that moment:
+void recordPresent(float speakerTime) {
+    // nothing to measure while paused
+    if (shownContentTime < 0 || speakerTime == lastPresent) return;
+    lastPresent = speakerTime;
+
+    samples[sampleHead] = speakerTime - shownContentTime;
+    sampleHead = (sampleHead + 1) % LATENCY_SAMPLES;
+    if (sampleCount < LATENCY_SAMPLES) sampleCount++;
+}
+
+// p in [0., 1.] over the recent presented frames (seconds):
+float latencyPercentile(float p) {
+    if (sampleCount == 0) return 0;
+
+    float sorted[LATENCY_SAMPLES];
+    memcpy(sorted, samples, sampleCount * sizeof(float));
+    int k = (int)(p * (sampleCount - 1) + 0.5f);
+    std::nth_element(sorted, sorted + k, sorted + sampleCount);
+    return sorted[k];
+}
+
+void printLatencyReport() {
+    fprintf(stderr, "A/V latency over %d frames (ms): min %.1f  p50 %.1f  p90 %.1f  p99 %.1f  max %.1f  [compensation %s, trim %+.0f]\n",
+            sampleCount,
+            1000 * latencyPercentile(0.f), 1000 * latencyPercentile(.5f), 1000 * latencyPercentile(.9f),
+            1000 * latencyPercentile(.99f), 1000 * latencyPercentile(1.f),
+            LatencyCompensationOn ? "on" : "off", 1000 * LatencyTrim);
+}
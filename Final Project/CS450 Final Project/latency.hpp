@@ -0,0 +1,32 @@
+//
+//  latency.hpp
+//  CS450 Final Project
+//
+
+#ifndef latency_hpp
+#define latency_hpp
+
+#include <stdio.h>
+#include <string.h>
+#include <cmath>
+#include <algorithm>
+#include "analysis_arena.hpp"
+
+// analysed frames kept for delaying the spectrum lookup (~250 ms at 60 fps):
+#define LATENCY_FRAMES      16
+// presented frames kept for the percentile report:
+#define LATENCY_SAMPLES     512
+
+extern bool     LatencyCompensationOn;  // look up the spectrum that matches what is being heard
+extern float    LatencyTrim;            // extra seconds added to the lookup time (+ pulls visuals earlier)
+
+void InitLatency(int channels, int res);
+
+void recordAnalysisFrame(float **spec, int channels, int res, float contentTime);
+float** lookupSpectrum(float speakerTime, int *channels);
+void recordPresent(float speakerTime);
+
+float latencyPercentile(float p);
+void printLatencyReport();
+
+#endif /* latency_hpp */
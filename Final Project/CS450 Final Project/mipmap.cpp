@@ -0,0 +1,177 @@
+//
+//  mipmap.cpp
+//  CS450 Final Project
+//
+//  Builds a full mip chain on the CPU with a 2x2 box filter. Each level is
+//  split into bands of rows that are filtered on their own threads; the
+//  plain filter averages bytes with SSE2 (SSSE3 for RGB), the gamma-correct
+//  one averages in linear light through lookup tables.
+//
+
+#include "mipmap.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
+unsigned short  srgbToLinear[256];      // 8 bit sRGB -> 16 bit linear
+unsigned char   linearToSrgb[4096];     // 12 bit linear -> 8 bit sRGB
+std::once_flag  gammaTablesBuilt;
+
+void buildGammaTables() {
+    for (int i = 0; i < 256; i++) {
+        float c = i / 255.f;
+        float l = (c <= 0.04045f) ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+        srgbToLinear[i] = (unsigned short)(l * 65535.f + 0.5f);
+    }
+    for (int i = 0; i < 4096; i++) {
+        float l = i / 4095.f;
+        float c = (l <= 0.0031308f) ? l * 12.92f : 1.055f * powf(l, 1.f/2.4f) - 0.055f;
+        linearToSrgb[i] = (unsigned char)(c * 255.f + 0.5f);
+    }
+}
+
+/**
+ ** average 2x2 blocks of src into rows [first, last) of dst
+ ** (an odd last row or column of src is dropped, as glGenerateMipmap does)
+ **/
+void downsampleRows(MipLevel *dst, MipLevel *src, int ncomps, bool gammaCorrect, int first, int last) {
+    int srcRow = ncomps * src->width;
+    int dstRow = ncomps * dst->width;
+
+    for (int t = first; t < last; t++) {
+        unsigned char *r0 = src->pixels + (size_t)(2*t) * srcRow;
+        unsigned char *r1 = (src->height > 1) ? r0 + srcRow : r0;
+        unsigned char *out = dst->pixels + (size_t)t * dstRow;
+        int step = (src->width > 1) ? ncomps : 0;     // 1 pixel wide levels pair a pixel with itself
+        int s = 0;
+
+        if (gammaCorrect) {
+            for (; s < dst->width; s++) {
+                unsigned char *a = r0 + 2*s*ncomps;
+                unsigned char *b = r1 + 2*s*ncomps;
+                for (int c = 0; c < 3; c++) {
+                    int sum = srgbToLinear[a[c]] + srgbToLinear[a[c + step]] + srgbToLinear[b[c]] + srgbToLinear[b[c + step]];
+                    // /4 and 16 -> 12 bits (rounding takes four whites to 4096)
+                    out[s*ncomps + c] = linearToSrgb[std::min((sum + 32) >> 6, 4095)];
+                }
+                if (ncomps == 4)
+                    out[s*4 + 3] = (a[3] + a[3 + step] + b[3] + b[3 + step] + 2) >> 2;
+            }
+            continue;
+        }
+
+#ifdef __SSE2__
+        // two output pixels from four input pixels of each row, summed in 16 bits
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i two = _mm_set1_epi16(2);
+#ifdef __SSSE3__
+        // RGB pixels are spread out to RGBX so they pair up like RGBA ones
+        const __m128i spread = _mm_setr_epi8(0, 1, 2, -1,  3, 4, 5, -1,  6, 7, 8, -1,  9, 10, 11, -1);
+        const __m128i gather = _mm_setr_epi8(0, 1, 2,  4, 5, 6,  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+        const bool spreadRgb = true;
+#else
+        const bool spreadRgb = false;
+#endif
+        if (step != 0 && (ncomps == 4 || spreadRgb)) {
+            for (; s + 2 <= dst->width && 2*s*ncomps + 16 <= srcRow; s += 2) {
+                __m128i a = _mm_loadu_si128((__m128i*)(r0 + 2*s*ncomps));
+                __m128i b = _mm_loadu_si128((__m128i*)(r1 + 2*s*ncomps));
+#ifdef __SSSE3__
+                if (ncomps == 3) {
+                    a = _mm_shuffle_epi8(a, spread);
+                    b = _mm_shuffle_epi8(b, spread);
+                }
+#endif
+                __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+                __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+                __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+                __m128i avg = _mm_packus_epi16(_mm_srli_epi16(_mm_add_epi16(sum, two), 2), zero);
+
+                unsigned char px[16];
+#ifdef __SSSE3__
+                if (ncomps == 3) avg = _mm_shuffle_epi8(avg, gather);
+#endif
+                _mm_storeu_si128((__m128i*)px, avg);
+                memcpy(out + s*ncomps, px, 2*ncomps);
+            }
+        }
+#endif
+
+        for (; s < dst->width; s++) {
+            unsigned char *a = r0 + 2*s*ncomps;
+            unsigned char *b = r1 + 2*s*ncomps;
+            for (int c = 0; c < ncomps; c++)
+                out[s*ncomps + c] = (a[c] + a[c + step] + b[c] + b[c + step] + 2) >> 2;
+        }
+    }
+}
+
+/**
+ ** build every level below pixels (which the chain takes ownership of) down to 1x1:
+ **/
+void BuildMipChain(unsigned char *pixels, int width, int height, int ncomps, bool gammaCorrect, MipChain *chain) {
+    memset(chain, 0, sizeof(MipChain));
+    chain->ncomps = ncomps;
+    chain->levels[0].pixels = pixels;
+    chain->levels[0].width = width;
+    chain->levels[0].height = height;
+    chain->numLevels = 1;
+
+    if (gammaCorrect)
+        std::call_once(gammaTablesBuilt, buildGammaTables);
+
+    int numThreads = std::thread::hardware_concurrency();
+    if (numThreads < 1) numThreads = 1;
+
+    while (chain->numLevels < MIP_MAX_LEVELS) {
+        MipLevel *src = &chain->levels[chain->numLevels - 1];
+        if (src->width == 1 && src->height == 1) break;
+
+        MipLevel *dst = &chain->levels[chain->numLevels++];
+        dst->width = (src->width > 1) ? src->width / 2 : 1;
+        dst->height = (src->height > 1) ? src->height / 2 : 1;
+        dst->pixels = new unsigned char[ (size_t)ncomps * dst->width * dst->height ];
+
+        // each level depends on the last, so only the rows within one are spread out
+        int bands = (dst->height + MIP_BAND_ROWS - 1) / MIP_BAND_ROWS;
+        int workers = (bands < numThreads) ? bands : numThreads;
+        if (workers <= 1) {
+            downsampleRows(dst, src, ncomps, gammaCorrect, 0, dst->height);
+            continue;
+        }
+
+        std::vector<std::thread> threads;
+        int rowsEach = (dst->height + workers - 1) / workers;
+        for (int w = 0; w < workers; w++) {
+            int first = w * rowsEach;
+            int last = std::min(first + rowsEach, dst->height);
+            if (first < last)
+                threads.push_back(std::thread(downsampleRows, dst, src, ncomps, gammaCorrect, first, last));
+        }
+        for (size_t i = 0; i < threads.size(); i++)
+            threads[i].join();
+    }
+}
+
+void FreeMipChain(MipChain *chain) {
+    for (int i = 0; i < chain->numLevels; i++)
+        delete [] chain->levels[i].pixels;
+    chain->numLevels = 0;
+}
+
+/**
+ ** upload every level of the chain into the currently bound 2D texture:
+ **/
+void MipTexImage2D(MipChain *chain) {
+    GLenum format = (chain->ncomps == 4) ? GL_RGBA : GL_RGB;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int i = 0; i < chain->numLevels; i++) {
+        MipLevel *level = &chain->levels[i];
+        glTexImage2D(GL_TEXTURE_2D, i, format, level->width, level->height, 0, format, GL_UNSIGNED_BYTE, level->pixels);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, chain->numLevels - 1);
+}
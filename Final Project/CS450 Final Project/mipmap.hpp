@@ -0,0 +1,51 @@
+//
+//  mipmap.hpp
+//  CS450 Final Project
+//
+
+#ifndef mipmap_hpp
+#define mipmap_hpp
+
+#ifdef WIN32
+#include <windows.h>
+#pragma warning(disable:4996)
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <GL/glu.h>
+#include <GL/glut.h>
+#else
+#include <GLUT/glut.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+
+// enough levels for a 32768 pixel texture:
+#define MIP_MAX_LEVELS      16
+// rows of a level given to each thread while downsampling:
+#define MIP_BAND_ROWS       32
+
+// one level of a chain: tightly packed RGB or RGBA rows, bottom row first
+typedef struct {
+    unsigned char *pixels;
+    int width, height;
+} MipLevel;
+
+typedef struct {
+    int ncomps;                 // 3 (RGB) or 4 (RGBA)
+    int numLevels;
+    MipLevel levels[MIP_MAX_LEVELS];
+} MipChain;
+
+void BuildMipChain(unsigned char *pixels, int width, int height, int ncomps, bool gammaCorrect, MipChain *chain);
+void FreeMipChain(MipChain *chain);
+void MipTexImage2D(MipChain *chain);
+
+#endif /* mipmap_hpp */
@@ -18,7 +18,19 @@
 //      p. Toggle particles
 //      v. Toggle visualizer
 //      r. Toggle rotation
+//      b. Toggle beat sync
+//      l. Print A/V latency report
+//      t. Print frame timing report
+//      h. Toggle the performance HUD
+//      x. Save a trace of the last few seconds (musicvisualizer-trace.json)
+//      w. Toggle the tiled world texture (when worldtex.vt is there)
 //      0,1,2. Toggle lights
+//  Music files named on the command line play together (default: delta-zone.mp3)
+//  and their channels can be assigned to the sphere and stage from the menu.
+//  -headless frames output [music files] renders that many frames with no window
+//  (see headless.cpp for the outputs), e.g. -headless 600 frames/%05d.ppm
+//  -axes, -texture, -particles, -stage, -visualizer, -rotate, -beatsync and -peaks
+//  flip those options from where Reset() leaves them, e.g. -headless 600 out.ppm -particles -stage
 //
 //	Author:			Kyler Stole
 
@@ -29,6 +41,7 @@
 #include <cstdlib>
 #include <ctype.h>
 #include <cmath>
+#include <string.h>
 
 #ifdef WIN32
 #include <windows.h>
@@ -49,6 +62,15 @@
 #include "sphere.hpp"
 #include "particles.hpp"
 #include "BmpToTexture.hpp"
+#include "beat.hpp"
+#include "bmp_bench.hpp"
+#include "texture_manager.hpp"
+#include "virtual_texture.hpp"
+#include "palette.hpp"
+#include "profiler.hpp"
+#include "hud.hpp"
+#include "scheduler.hpp"
+#include "render_queue.hpp"
 
 // title of these windows:
 const char *WINDOWTITLE = { "OpenGL / Final Project -- Kyler Stole" };
@@ -59,6 +81,25 @@ const char *GLUITITLE   = { "User Interface Window" };
 // animation cycle time
 #define MS_IN_THE_ANIMATION_CYCLE 2000
 
+// beats per sphere revolution and particles released on each beat when beat synced
+#define BEATS_PER_REVOLUTION 4
+#define BEAT_BURST 150
+
+// spectrum smoothing presets (attack, release in seconds), in menu order
+const float SMOOTHING[4][2] = {
+    { 0.f,   0.f  },    // off
+    { 0.01f, 0.08f },   // light
+    { 0.02f, 0.15f },   // medium
+    { 0.05f, 0.35f },   // heavy
+};
+
+// peak hold presets (hold in seconds, fall in spectrum units per second), in
+// menu order after "Off"
+const float PEAK_HOLD[2][2] = {
+    { 0.25f, 0.1f  },   // short
+    { 1.f,   0.03f },   // long
+};
+
 // fog parameters:
 const GLfloat FOGCOLOR[4] = {.0, .0, .0, 1.};
 const GLenum  FOGMODE     = {GL_LINEAR};
@@ -79,6 +120,10 @@ bool    Light0On;
 bool    Light1On;
 bool    Light2On;
 bool RotateOn;
+bool BeatSyncOn;
+bool VirtualTextureOn;       // texture the globe from the tile pack
+int SphereChannel;          // first of the channel pair driving the sphere
+int StageChannel;           // first of the channel pair driving the stage
 
 // window background color (rgba):
 const GLfloat BACKCOLOR[] = { 0., 0., 0., 1. };
@@ -91,22 +136,86 @@ const GLfloat BACKCOLOR[] = { 0., 0., 0., 1. };
 #define SPHERE_SLICES   100
 #define SPHERE_STACKS   50
 
+// scene options that can be flipped from the command line, e.g. -particles -stage:
+struct SceneOption {
+    const char *name;
+    bool *on;
+    bool flip;
+};
+SceneOption SceneOptions[] = {
+    { "-axes",       &AxesOn,       false },
+    { "-texture",    &TextureOn,    false },
+    { "-particles",  &ParticlesOn,  false },
+    { "-stage",      &StageOn,      false },
+    { "-visualizer", &VisualizerOn, false },
+    { "-rotate",     &RotateOn,     false },
+    { "-beatsync",   &BeatSyncOn,   false },
+    { "-peaks",      &PeakHoldOn,   false },
+};
+#define NUM_SCENE_OPTIONS (int)(sizeof(SceneOptions) / sizeof(SceneOptions[0]))
+
+// takes the scene options out of the arguments, leaving the rest in order:
+void parseSceneOptions(int *argc, char *argv[]) {
+    int kept = 1;
+    for (int i = 1; i < *argc; i++) {
+        int o = 0;
+        while (o < NUM_SCENE_OPTIONS && strcmp(argv[i], SceneOptions[o].name) != 0) o++;
+        if (o < NUM_SCENE_OPTIONS) SceneOptions[o].flip = !SceneOptions[o].flip;
+        else argv[kept++] = argv[i];
+    }
+    *argc = kept;
+}
+
+// flips the options asked for from their Reset() values:
+void applySceneOptions() {
+    for (int o = 0; o < NUM_SCENE_OPTIONS; o++)
+        if (SceneOptions[o].flip) *SceneOptions[o].on = !*SceneOptions[o].on;
+}
+
 
 // MARK: - Main
 int main(int argc, char *argv[]) {
+    // texture loader benchmark (no window needed):  -bmpbench file.bmp [iterations]
+    if (argc > 2 && strcmp(argv[1], "-bmpbench") == 0) {
+        BmpBenchmark(argv[2], (argc > 3) ? atoi(argv[3]) : 5);
+        return 0;
+    }
+    
+    // cut a huge map into a tile pack for the virtual texture:  -vtbuild file.bmp file.vt
+    if (argc > 3 && strcmp(argv[1], "-vtbuild") == 0)
+        return BuildVirtualTexture(argv[2], argv[3]) ? 0 : 1;
+    
+    // render offscreen with no window:  -headless frames output [options] [music files...]
+    HeadlessArgs(&argc, &argv);
+    
     // turn on the glut package:
     // (do this before checking argc and argv since it might
     // pull some command line arguments out)
-    glutInit(&argc, argv);
+    if (!Headless) glutInit(&argc, argv);
+    parseSceneOptions(&argc, argv);
     
-    InitFMOD(SPHERE_SLICES);
+    // any files left on the command line are played together as extra streams
+    InitFMOD(SPHERE_SLICES, argc-1, &argv[1]);
+    if (Headless) {
+        if (!InitHeadless(INIT_WINDOW_SIZE, INIT_WINDOW_SIZE, HeadlessOutput)) return 1;
+    }
+    InitStateCache(); // (before anything sets GL state through it)
     InitGraphics();
+    InitTrace(); // zone recorder for every thread (before any threads start)
+    InitProfiler(); // per-stage timers (after the GL context exists)
+    if (!Headless) InitHud(); // (GLUT's font)
     InitTextures(); // import textures
     InitLists(); // display structures that will not change
+    InitMaterials(); // state setups for the render queue
     InitParticles();
     setSphereRadius(SPHERE_RADIUS);
+    InitScheduler(stepParticles); // particles step on their own thread from here on
     
     Reset(); // init global vars used by Display() (and post redisplay)
+    applySceneOptions();
+    
+    // frame by frame on the frame clock, then quit (cleaning up on the way out)
+    if (Headless) return HeadlessRun(Animate, Display);
     
     InitMenus(); // builds right-click menu
     
@@ -127,9 +236,13 @@ int main(int argc, char *argv[]) {
 // do not call Display() from here -- let glutMainLoop() do it
 
 void Animate() {
+    // sleep until the next frame is due (rather than spin in the idle callback)
+    WaitForFrame();
+    PROFILE_ZONE("Animate");
+    
     // put animation stuff in here -- change some global variables
     // for Display() to find:
-    int ms = glutGet(GLUT_ELAPSED_TIME);                    // milliseconds
+    int ms = ElapsedMs();                                   // milliseconds
     int ms2 = ms % (4*MS_IN_THE_ANIMATION_CYCLE);
     Time = (float)ms / (float)1000;
     ms %= MS_IN_THE_ANIMATION_CYCLE;
@@ -139,9 +252,17 @@ void Animate() {
     if (SwitchCycle < 0.5) DayMode = true;
     else DayMode = false;
     
-    idleParticles();
+    // advance the beat grid to the part of the song on screen (what is heard,
+    // with latency compensation), so bursts and the bar land with the audio
+    updateBeatClock(visualTime());
+    if (BeatSyncOn && BeatHit && ParticlesOn)
+        burstParticles(BEAT_BURST);
+    
+    // the simulation thread steps the particles; headless frames step them here
+    if (Headless) RunSimulationTicks(SIM_HZ / HEADLESS_FPS);
     
     // force a call to Display() next time it is convenient:
+    if (Headless) return;
     glutSetWindow(MainWindow);
     glutPostRedisplay();
 }
@@ -165,26 +286,152 @@ void drawPlatformOld() {
 #define STAGE_HEIGHT    -2
 #define STAGE_RES       10
 
-void drawStage(float **spec) {
-    if (!spec) return;
+// the stage's teal, lifting through the sphere's cyan to white as the ripple deepens:
+constexpr ColorStop stageStops[] = { {0., 0., .5, .5}, {.5, .2, .8, .88}, {1., 1., 1., 1.} };
+constexpr ColorLut<64> StageLut = GradientLut<64>(stageStops, 255);
+
+// MARK: - Render queue materials and draws
+
+// the scene's materials, in the order their draws run within a pass:
+enum SceneMaterials {
+    MAT_UNLIT,          // vertex colors: the axes and the stage
+    MAT_LIT,            // the sphere
+    MAT_LIT_TEXTURED,   // the sphere, textured
+    MAT_POINTS,         // the particles
+    MAT_TEXT            // screen text
+};
+
+// the pair of channels driving an object:
+typedef struct {
+    float *first, *second;
+} SpectrumPair;
+
+// channel and the one after it, or channel twice if it has no partner in its stream
+// (rows is spectrumChannel or peakChannel):
+SpectrumPair spectrumPair(int channel, float* (*rows)(int) = spectrumChannel) {
+    SpectrumPair pair = { rows(channel), NULL };
+    if (channelStream(channel + 1) == channelStream(channel))
+        pair.second = rows(channel + 1);
+    if (!pair.second) pair.second = pair.first;
+    return pair;
+}
+
+void applyUnlit() {
+    stateDisable(GL_LIGHTING);
+    stateDisable(GL_TEXTURE_2D);
+    stateDisable(GL_BLEND);
+    stateDepthMask(GL_TRUE);
+}
+
+void applyLit() {
+    stateEnable(GL_LIGHTING);
+    stateDisable(GL_TEXTURE_2D);
+    stateDisable(GL_BLEND);
+    stateDepthMask(GL_TRUE);
+    stateShadeModel(GL_SMOOTH);
+    SetMaterial(1., 0.7, 1., 50);
+    stateTexEnvMode(GL_MODULATE);
+}
+
+void applyLitTextured() {
+    applyLit();
+    stateEnable(GL_TEXTURE_2D);
+}
+
+// blended over what is behind them, and sorted among themselves rather than depth tested:
+void applyPoints() {
+    stateDisable(GL_LIGHTING);
+    stateDisable(GL_TEXTURE_2D);
+    stateEnable(GL_BLEND);
+    stateBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    stateDepthMask(GL_FALSE);
+}
+
+void applyText() {
+    stateDisable(GL_DEPTH_TEST);
+    stateDisable(GL_LIGHTING);
+    stateDisable(GL_TEXTURE_2D);
+}
+
+void InitMaterials() {
+    setRenderMaterial(MAT_UNLIT, applyUnlit);
+    setRenderMaterial(MAT_LIT, applyLit);
+    setRenderMaterial(MAT_LIT_TEXTURED, applyLitTextured);
+    setRenderMaterial(MAT_POINTS, applyPoints);
+    setRenderMaterial(MAT_TEXT, applyText);
+}
+
+// color is the axes' rgb:
+void drawAxes(const void *color) {
+    glColor3fv((const GLfloat*)color);
+    glCallList(AxesList);
+    profileCount(COUNT_DRAW_CALLS, 1);
+}
+
+// spectra is the sphere's SpectrumPair (upper, lower):
+void drawSphere(const void *spectra) {
+    const SpectrumPair *pair = (const SpectrumPair*)spectra;
+    PROFILE_ZONE("Sphere");
     
-    glPushMatrix();
+    glColor3ub(51, 205, 225);
+    if (TextureOn && VirtualTextureOn)
+        DrawVirtualSphere(SPHERE_RADIUS, SPHERE_SLICES, SPHERE_STACKS, pair->first, pair->second);
+    else {
+        if (TextureOn) BindTexture(texDay);
+        MjbSphere(SPHERE_RADIUS, SPHERE_SLICES, SPHERE_STACKS, pair->first, pair->second);
+    }
+}
 
-    glColor3ub(0, 128, 128);
+// peaks is the sphere's SpectrumPair of held peaks:
+void drawSpherePeaks(const void *peaks) {
+    const SpectrumPair *pair = (const SpectrumPair*)peaks;
+    if (!pair->first) return;
+    
+    glColor3ub(255, 255, 255);
+    MjbSpherePeaks(SPHERE_RADIUS, SPHERE_SLICES, SPHERE_STACKS, pair->first, pair->second);
+}
+
+void drawParticleSystem(const void *) {
+    drawParticles();
+}
+
+// the title, in percent units over the whole viewport:
+void drawTitle(const void *) {
+    PROFILE_ZONE("Text");
+    
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    gluOrtho2D(0., 100., 0., 100.);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    glColor3f(1., 1., 1.);
+    DoRasterString(5., 5., 0., "Kyler Stole - CS 450 - Final Project");
+}
+
+// spectra is the stage's SpectrumPair (left, right), rippling it along z and x
+void drawStage(const void *spectra) {
+    float *left = ((const SpectrumPair*)spectra)->first;
+    float *right = ((const SpectrumPair*)spectra)->second;
+    if (!left || !right) return;
+    PROFILE_ZONE("Stage");
+    
+    glPushMatrix();
     
     float divs = (float)(STAGE_RIGHT - STAGE_LEFT) / STAGE_RES;
     for (float x = STAGE_LEFT; x < STAGE_RIGHT; x += divs) {
         float newX = rerange(x, STAGE_LEFT, STAGE_RIGHT, -M_PI, M_PI);
-        float xBulge =  (cosf(newX) + 1) * spec[1][5];
+        float xBulge =  (cosf(newX) + 1) * right[5];
         glBegin(GL_TRIANGLE_STRIP);
         for (float z = STAGE_LEFT; z < STAGE_RIGHT; z += divs) {
             float newZ = rerange(z, STAGE_LEFT, STAGE_RIGHT, -M_PI, M_PI);
-            float zBulge =  (cosf(newZ) + 1) * spec[0][5];
+            float zBulge =  (cosf(newZ) + 1) * left[5];
             float y = STAGE_HEIGHT - xBulge * zBulge * 80;
+            glColor4ubv(StageLut(xBulge * zBulge * 80));
             glVertex3f(x, y, z);
             glVertex3f(x+divs, y, z);
         }
         glEnd();
+        profileCount(COUNT_DRAW_CALLS, 1);
     }
     
     glPopMatrix();
@@ -193,27 +440,37 @@ void drawStage(float **spec) {
 // draw the complete scene:
 
 void Display() {
+    TRACE_ZONE("Display"); // trace only: the stages inside stay top level zones for the GPU timers
+    
     if (DebugOn)
         fprintf(stderr, "Display\n");
     
     
     // set which window we want to do the graphics into:
-    glutSetWindow(MainWindow);
+    if (!Headless) glutSetWindow(MainWindow);
+    
+    
+    // feed a bounded slice of any pending textures to the GPU, and keep under budget:
+    int zone = profileBegin("Uploads");
+    UpdateTextures();
+    if (VirtualTextureOn) UpdateVirtualTexture();
+    profileEnd(zone);
     
     
     // erase the background:
-    glDrawBuffer(GL_BACK);
+    zone = profileBegin("Setup");
+    if (!Headless) glDrawBuffer(GL_BACK); // (headless draws into its framebuffer object)
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glEnable(GL_DEPTH_TEST);
+    stateEnable(GL_DEPTH_TEST);
     
     
     // specify shading to be smooth:
-    glShadeModel(GL_SMOOTH);
+    stateShadeModel(GL_SMOOTH);
     
     
     // set the viewport to a square centered in the window:
-    GLsizei vx = glutGet(GLUT_WINDOW_WIDTH);
-    GLsizei vy = glutGet(GLUT_WINDOW_HEIGHT);
+    GLsizei vx, vy;
+    HeadlessWindowSize(&vx, &vy);
     GLsizei v = vx < vy ? vx : vy;			// minimum dimension
     GLint xl = (vx - v) / 2;
     GLint yb = (vy - v) / 2;
@@ -262,26 +519,22 @@ void Display() {
     
     // set the fog parameters:
     if (DepthCueOn) {
-        glFogi(GL_FOG_MODE, FOGMODE);
-        glFogfv(GL_FOG_COLOR, FOGCOLOR);
-        glFogf(GL_FOG_DENSITY, FOGDENSITY);
-        glFogf(GL_FOG_START, FOGSTART);
-        glFogf(GL_FOG_END, FOGEND);
-        glEnable(GL_FOG);
+        stateFogi(GL_FOG_MODE, FOGMODE);
+        stateFogfv(GL_FOG_COLOR, FOGCOLOR);
+        stateFogf(GL_FOG_DENSITY, FOGDENSITY);
+        stateFogf(GL_FOG_START, FOGSTART);
+        stateFogf(GL_FOG_END, FOGEND);
+        stateEnable(GL_FOG);
     } else {
-        glDisable(GL_FOG);
+        stateDisable(GL_FOG);
     }
     
-    // color the scene
-    glColor3fv(&Colors[WhichColor][0]);
-    
-    // possibly draw the axes:
-    if (AxesOn)
-        glCallList(AxesList);
+    // possibly draw the axes (in the scene's color):
+    if (AxesOn) submitDraw(PASS_OPAQUE, MAT_UNLIT, 0, vec3(), drawAxes, &Colors[WhichColor][0]);
     
     
     // since we are using glScalef(), be sure normals get unitized:
-    glEnable(GL_NORMALIZE);
+    stateEnable(GL_NORMALIZE);
     
     // glut solids
     
@@ -301,39 +554,46 @@ void Display() {
     SetSpotLight(GL_LIGHT1, l0pos.x, l0pos.y, l0pos.z, -l0pos.x, -l0pos.y, -l0pos.z, .73, .29, .31);
     glPopMatrix();
     
-    (Light0On) ? glEnable(GL_LIGHT0) : glDisable(GL_LIGHT0);
-    (Light1On) ? glEnable(GL_LIGHT1) : glDisable(GL_LIGHT1);
-    (Light2On) ? glEnable(GL_LIGHT2) : glDisable(GL_LIGHT2);
+    stateSet(GL_LIGHT0, Light0On);
+    stateSet(GL_LIGHT1, Light1On);
+    stateSet(GL_LIGHT2, Light2On);
+    profileEnd(zone);
+    
+    zone = profileBegin("Analysis");
+    freq_analysis(SPHERE_SLICES);
+    profileEnd(zone);
     
-    float **spec = freq_analysis(SPHERE_SLICES);
+    // each object takes a pair of channels (a mono source drives both sides with one)
+    SpectrumPair sphereSpectra = spectrumPair(SphereChannel);
+    SpectrumPair stageSpectra = spectrumPair(StageChannel);
+    SpectrumPair spherePeaks = spectrumPair(SphereChannel, peakChannel);
     
-    glEnable(GL_LIGHTING);
+    // the draws from here on are queued, and run by pass, material and texture
+    // rather than in this order (see render_queue.cpp)
     
     /* Visualizers */
     glPushMatrix();
-    glShadeModel(GL_SMOOTH);
-    SetMaterial(1., 0.7, 1., 50);
-    glColor3ub(51, 205, 225);
-    glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
-    
-    if (TextureOn) {
-        glEnable(GL_TEXTURE_2D);
-        glBindTexture(GL_TEXTURE_2D, texDay);
+    if (RotateOn) {
+        // lock the rotation to the bar once a tempo has been found
+        if (BeatSyncOn && BeatBPM > 0) {
+            float bar = (float)(BeatCount % BEATS_PER_REVOLUTION) + BeatPhase;
+            glRotatef(bar / BEATS_PER_REVOLUTION * 360, 0., 1., 0.);
+        } else {
+            glRotatef(TimeCycle*360, 0., 1., 0.);
+        }
+    }
+    if (VisualizerOn) {
+        int texture = (TextureOn && !VirtualTextureOn) ? texDay + 1 : 0;
+        submitDraw(PASS_OPAQUE, TextureOn ? MAT_LIT_TEXTURED : MAT_LIT, texture, vec3(), drawSphere, &sphereSpectra);
+        if (PeakHoldOn) submitDraw(PASS_OPAQUE, MAT_UNLIT, 0, vec3(), drawSpherePeaks, &spherePeaks);
     }
-
-    if (RotateOn) glRotatef(TimeCycle*360, 0., 1., 0.);
-    if (VisualizerOn) MjbSphere(SPHERE_RADIUS, SPHERE_SLICES, SPHERE_STACKS, spec);
-    
-    if (TextureOn) glDisable(GL_TEXTURE_2D);
-    
-    glDisable(GL_LIGHTING);
     glPopMatrix();
     
     /* Particles */
-    if (ParticlesOn) drawParticles();
+    if (ParticlesOn) submitDraw(PASS_BLENDED, MAT_POINTS, 0, vec3(), drawParticleSystem, NULL);
     
     /* Stage */
-    if (StageOn) drawStage(spec);
+    if (StageOn) submitDraw(PASS_OPAQUE, MAT_UNLIT, 0, vec3(0, STAGE_HEIGHT, 0), drawStage, &stageSpectra);
     
     
     // draw some gratuitous text that just rotates on top of the scene:
@@ -351,18 +611,19 @@ void Display() {
     //
     // the modelview matrix is reset to identity as we don't
     // want to transform these coordinates
-    glDisable(GL_DEPTH_TEST);
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    gluOrtho2D(0., 100., 0., 100.);
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
-    glColor3f(1., 1., 1.);
-    DoRasterString(5., 5., 0., "Kyler Stole - CS 450 - Final Project");
+    submitDraw(PASS_OVERLAY, MAT_TEXT, 0, vec3(), drawTitle, NULL);
+    
+    ExecuteRenderQueue();
+    
+    DrawHud();
     
     
     // swap the double-buffered framebuffers:
-    glutSwapBuffers();
+    zone = profileBegin("Swap");
+    HeadlessSwapBuffers();
+    profileEnd(zone);
+    recordPresent(speakerTime());
+    ProfileFrame();
     
     
     // be sure the graphics buffer has been sent:
@@ -378,6 +639,102 @@ void DoBulgeMenu(int id) {
 }
 
 
+void DoSmoothingMenu(int id) {
+    setSmoothing(SMOOTHING[id][0], SMOOTHING[id][1]);
+    
+    glutSetWindow(MainWindow);
+    glutPostRedisplay();
+}
+
+// 0 turns peak hold off, 1 and up pick a PEAK_HOLD preset:
+void DoPeakHoldMenu(int id) {
+    PeakHoldOn = (id > 0);
+    if (PeakHoldOn) setPeakHold(PEAK_HOLD[id-1][0], PEAK_HOLD[id-1][1]);
+    
+    glutSetWindow(MainWindow);
+    glutPostRedisplay();
+}
+
+
+// latency menu ids:
+enum LatencyVals {
+    COMP_OFF,
+    COMP_ON,
+    TRIM_EARLIER,
+    TRIM_LATER,
+    TRIM_RESET,
+    LATENCY_REPORT
+};
+
+void DoLatencyMenu(int id) {
+    switch (id) {
+        case COMP_OFF:      LatencyCompensationOn = false;  break;
+        case COMP_ON:       LatencyCompensationOn = true;   break;
+        case TRIM_EARLIER:  LatencyTrim += 0.01f;           break;
+        case TRIM_LATER:    LatencyTrim -= 0.01f;           break;
+        case TRIM_RESET:    LatencyTrim = 0;                break;
+        case LATENCY_REPORT: break;
+    }
+    printLatencyReport();
+    
+    glutSetWindow(MainWindow);
+    glutPostRedisplay();
+}
+
+void DoProfilerMenu(int id) {
+    switch (id) {
+        case 0: case 1:     ProfileOn = id;                 break;
+        case 2:             printProfileReport();           break;
+        case 3:             DumpTrace(TRACE_FILE);          break;
+        case 4:             StateCacheOn = !StateCacheOn;   break;
+    }
+    
+    glutSetWindow(MainWindow);
+    glutPostRedisplay();
+}
+
+// frame rates to sleep to, or PACE_VSYNC / PACE_OFF:
+void DoPacingMenu(int id) {
+    if (id > PACE_OFF) {
+        TargetFps = id;
+        SetFramePacing(PACE_SLEEP);
+    } else
+        SetFramePacing(id);
+    
+    glutSetWindow(MainWindow);
+    glutPostRedisplay();
+}
+
+// an entry for each channel pair of each stream, in analysis order (a pair never
+// spans two streams; a stream's odd channel out gets an entry of its own):
+void addChannelPairEntries() {
+    char pairName[32];
+    for (int s = 0; s < streamCount(); s++) {
+        int first = streamFirstChannel(s), channels = streamChannels(s);
+        for (int c = 0; c < channels; c += 2) {
+            int n = (streamCount() > 1) ? sprintf(pairName, "Stream %d: ", s+1) : 0;
+            if (c+1 < channels) sprintf(pairName + n, "%d + %d", c+1, c+2);
+            else sprintf(pairName + n, "%d", c+1);
+            glutAddMenuEntry(pairName, first + c);
+        }
+    }
+}
+
+void DoSphereChannelMenu(int id) {
+    SphereChannel = id;
+    
+    glutSetWindow(MainWindow);
+    glutPostRedisplay();
+}
+
+void DoStageChannelMenu(int id) {
+    StageChannel = id;
+    
+    glutSetWindow(MainWindow);
+    glutPostRedisplay();
+}
+
+
 // initialize the glui window:
 void InitMenus() {
     glutSetWindow(MainWindow);
@@ -411,6 +768,7 @@ void InitMenus() {
     int particlemenu = glutCreateMenu(DoParticleMenu);
     glutAddMenuEntry("[-] Less flow", '-');
     glutAddMenuEntry("[+] More flow", '+');
+    glutAddMenuEntry("[h] Color by height", 'h');
     
     int bulgemenu = glutCreateMenu(DoBulgeMenu);
     glutAddMenuEntry("2", 2);
@@ -418,6 +776,45 @@ void InitMenus() {
     glutAddMenuEntry("6", 6);
     glutAddMenuEntry("8", 8);
     
+    int smoothingmenu = glutCreateMenu(DoSmoothingMenu);
+    glutAddMenuEntry("Off",     0);
+    glutAddMenuEntry("Light",   1);
+    glutAddMenuEntry("Medium",  2);
+    glutAddMenuEntry("Heavy",   3);
+    
+    int peakholdmenu = glutCreateMenu(DoPeakHoldMenu);
+    glutAddMenuEntry("Off",     0);
+    glutAddMenuEntry("Short",   1);
+    glutAddMenuEntry("Long",    2);
+    
+    int latencymenu = glutCreateMenu(DoLatencyMenu);
+    glutAddMenuEntry("Compensation off",    COMP_OFF);
+    glutAddMenuEntry("Compensation on",     COMP_ON);
+    glutAddMenuEntry("Visuals 10 ms earlier", TRIM_EARLIER);
+    glutAddMenuEntry("Visuals 10 ms later",   TRIM_LATER);
+    glutAddMenuEntry("Reset trim",          TRIM_RESET);
+    glutAddMenuEntry("Report",              LATENCY_REPORT);
+    
+    int profilermenu = glutCreateMenu(DoProfilerMenu);
+    glutAddMenuEntry("Off",     0);
+    glutAddMenuEntry("On",      1);
+    glutAddMenuEntry("Report",  2);
+    glutAddMenuEntry("Save trace", 3);
+    glutAddMenuEntry("Toggle state cache", 4);
+    
+    int pacingmenu = glutCreateMenu(DoPacingMenu);
+    glutAddMenuEntry("30 fps",  30);
+    glutAddMenuEntry("60 fps",  60);
+    glutAddMenuEntry("120 fps", 120);
+    glutAddMenuEntry("Vsync",   PACE_VSYNC);
+    glutAddMenuEntry("Unpaced", PACE_OFF);
+    
+    int spherechannelmenu = glutCreateMenu(DoSphereChannelMenu);
+    addChannelPairEntries();
+    
+    int stagechannelmenu = glutCreateMenu(DoStageChannelMenu);
+    addChannelPairEntries();
+    
     glutCreateMenu(DoMainMenu);
     glutAddSubMenu(  "Axes",          axesmenu);
     glutAddSubMenu(  "Distortion",    distortmenu);
@@ -426,6 +823,13 @@ void InitMenus() {
     glutAddSubMenu(  "Projection",    projmenu);
     glutAddSubMenu(  "Particles",     particlemenu);
     glutAddSubMenu(  "Bulge",         bulgemenu);
+    glutAddSubMenu(  "Smoothing",     smoothingmenu);
+    glutAddSubMenu(  "Peak hold",     peakholdmenu);
+    glutAddSubMenu(  "Sphere channels", spherechannelmenu);
+    glutAddSubMenu(  "Stage channels",  stagechannelmenu);
+    glutAddSubMenu(  "Latency",       latencymenu);
+    glutAddSubMenu(  "Profiler",      profilermenu);
+    glutAddSubMenu(  "Frame pacing",  pacingmenu);
     glutAddMenuEntry("Reset",         RESET);
     glutAddSubMenu(  "Debug",         debugmenu);
     glutAddMenuEntry("Quit",          QUIT);
@@ -436,49 +840,21 @@ void InitMenus() {
 
 // import textures
 void InitTextures() {
-    int width, height, level, ncomps, border;
-    level = 0;
-    ncomps = 3;
-    border = 0;
-    
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
     
-    glGenTextures(1, &texDay);
-    glGenTextures(1, &texLight);
-    glGenTextures(1, &texMoon);
-    
-    width = 1024;
-    height = 512;
-    unsigned char* Texture0 = BmpToTexture((char*)"worldtex.bmp", &width, &height);
-    
-    glBindTexture(GL_TEXTURE_2D, texDay);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, level, ncomps, width, height, border, GL_RGB, GL_UNSIGNED_BYTE, Texture0);
-    
-//    width = 2048;
-//    height = 1024;
-//    unsigned char* Texture1 = BmpToTexture((char*)"night_world.bmp", &width, &height);
-//    
-//    glBindTexture(GL_TEXTURE_2D, texLight);
-//    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
-//    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
-//    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-//    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-//    glTexImage2D(GL_TEXTURE_2D, level, ncomps, width, height, border, GL_RGB, GL_UNSIGNED_BYTE, Texture1);
-//    
-//    width = 4096;
-//    height = 2048;
-//    unsigned char* Texture2 = BmpToTexture((char*)"moon.bmp", &width, &height);
-//    
-//    glBindTexture(GL_TEXTURE_2D, texMoon);
-//    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
-//    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
-//    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-//    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-//    glTexImage2D(GL_TEXTURE_2D, level, ncomps, width, height, border, GL_RGB, GL_UNSIGNED_BYTE, Texture2);
+    InitTextureLoader(2);
+    InitTextureManager(TEXTURE_BUDGET_BYTES);
+    
+    // read in the background and uploaded a slice per frame (grey until then),
+    // with a gamma-correct mip chain so the zoomed out globe filters trilinearly,
+    // compressed to BC1 and cached on disk after the first run
+    texDay = AcquireTexture((char*)"worldtex.bmp", TEXTURE_MIPMAPS | TEXTURE_SRGB | TEXTURE_COMPRESSED);
+    
+    // a map too big for one texture streams in by tiles instead, if it has been cut
+    VirtualTextureOn = InitVirtualTexture((char*)"worldtex.vt");
+    
+//    texLight = AcquireTexture((char*)"night_world.bmp", TEXTURE_MIPMAPS | TEXTURE_SRGB | TEXTURE_COMPRESSED);
+//    texMoon = AcquireTexture((char*)"moon.bmp", TEXTURE_MIPMAPS | TEXTURE_SRGB | TEXTURE_COMPRESSED);
     
     
     glMatrixMode(GL_TEXTURE);
@@ -488,23 +864,32 @@ void InitTextures() {
 // initialize the glut and OpenGL libraries:
 //	also setup display lists and callback functions
 void InitGraphics() {
-    // request the display modes:
-    // ask for red-green-blue-alpha color, double-buffering, and z-buffering:
-    glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE | GLUT_DEPTH);
-    
-    // set the initial window configuration:
-    glutInitWindowPosition(0, 0);
-    glutInitWindowSize(INIT_WINDOW_SIZE, INIT_WINDOW_SIZE);
-    
-    // open the window and set its title:
-    MainWindow = glutCreateWindow(WINDOWTITLE);
-    glutSetWindowTitle(WINDOWTITLE);
+    // (headless already has its offscreen context)
+    if (!Headless) {
+        // request the display modes:
+        // ask for red-green-blue-alpha color, double-buffering, and z-buffering:
+        glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE | GLUT_DEPTH);
+        
+        // set the initial window configuration:
+        glutInitWindowPosition(0, 0);
+        glutInitWindowSize(INIT_WINDOW_SIZE, INIT_WINDOW_SIZE);
+        
+        // open the window and set its title:
+        MainWindow = glutCreateWindow(WINDOWTITLE);
+        glutSetWindowTitle(WINDOWTITLE);
+    }
     
     // set the framebuffer clear values:
     glClearColor(BACKCOLOR[0], BACKCOLOR[1], BACKCOLOR[2], BACKCOLOR[3]);
     
     // set lights
-    glLightModelfv(GL_LIGHT_MODEL_AMBIENT, MulArray3(.3f, White));
+    glLightModelfv(GL_LIGHT_MODEL_AMBIENT, vec4(.3f * White.xyz(), 1.));
+    
+    // (no window, so no reshape callback: set up what it would have)
+    if (Headless) {
+        reshape(INIT_WINDOW_SIZE, INIT_WINDOW_SIZE);
+        return;
+    }
     
     // setup the callback functions:
     // DisplayFunc -- redraw the window
@@ -545,7 +930,7 @@ void InitGraphics() {
     glutDialsFunc(NULL);
     glutTabletMotionFunc(NULL);
     glutTabletButtonFunc(NULL);
-    glutMenuStateFunc(menustate);
+    glutMenuStateFunc(NULL);
     glutTimerFunc(-1, NULL, 0);
     AnimateFunc = Animate;
     
@@ -569,7 +954,7 @@ void InitGraphics() {
 //  memory so that they can be played back efficiently at a later time
 //  with a call to glCallList()
 void InitLists() {
-    glutSetWindow(MainWindow);
+    if (!Headless) glutSetWindow(MainWindow);
     
     // create the axes
     AxesList = glGenLists(1);
@@ -609,6 +994,7 @@ void Keyboard(unsigned char c, int x, int y) {
             
         case 'f': case 'F':
             Frozen = !Frozen;
+            SimulationPaused = Frozen;
             if (Frozen) glutIdleFunc(NULL);
             else glutIdleFunc(Animate);
             break;
@@ -617,6 +1003,30 @@ void Keyboard(unsigned char c, int x, int y) {
             RotateOn = !RotateOn;
             break;
             
+        case 'b': case 'B':
+            BeatSyncOn = !BeatSyncOn;
+            break;
+            
+        case 'l': case 'L':
+            printLatencyReport();
+            break;
+            
+        case 't': case 'T':
+            printProfileReport();
+            break;
+            
+        case 'h': case 'H':
+            HudOn = !HudOn;
+            break;
+            
+        case 'x': case 'X':
+            DumpTrace(TRACE_FILE);
+            break;
+            
+        case 'w': case 'W':
+            if (ResidentTiles() > 0) VirtualTextureOn = !VirtualTextureOn;
+            break;
+            
         case '0':
             Light0On = !Light0On;
             break;
@@ -661,6 +1071,10 @@ void Reset() {
     StageOn = false;
     bounceMult = 8;
     RotateOn = false;
+    BeatSyncOn = true;
+    PeakHoldOn = false;
+    SphereChannel = 0;
+    StageChannel = 0;
 }
 
 
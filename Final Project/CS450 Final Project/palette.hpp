@@ -0,0 +1,125 @@
+//
+//  palette.hpp
+//  CS450 Final Project
+//
+//  Color ramps baked into fixed size RGBA8 tables by the compiler, so a
+//  renderer turns a 0..1 value into a color with one index:
+//      constexpr ColorStop heat[] = { {0., 0., 0., 0.}, {.5, 1., 0., 0.}, {1., 1., 1., 0.} };
+//      constexpr ColorLut<256> HeatLut = GradientLut<256>(heat, 255);
+//      glColor4ubv(HeatLut(t));
+//  (C++11 constexpr, so everything below is one return statement)
+//
+
+#ifndef palette_hpp
+#define palette_hpp
+
+// one point on a gradient: the color at position t (0..1, stops in increasing t)
+struct ColorStop {
+    float t, r, g, b;
+};
+
+template <int N>
+struct ColorLut {
+    unsigned char rgba[N][4];
+
+    // nearest entry for t in 0..1 (clamped):
+    const unsigned char* operator()(float t) const {
+        int i = (int)(t * (N - 1) + .5f);
+        return rgba[(i < 0) ? 0 : ((i >= N) ? N - 1 : i)];
+    }
+    const unsigned char* operator[](int i) const {
+        return rgba[i];
+    }
+};
+
+
+// MARK: - Compile-time helpers
+
+// the 0..N-1 pack the tables are expanded over:
+template <int... I> struct LutIndices {};
+template <int N, int... I> struct MakeLutIndices : MakeLutIndices<N - 1, N - 1, I...> {};
+template <int... I> struct MakeLutIndices<0, I...> { typedef LutIndices<I...> type; };
+
+constexpr float lutClamp(float x, float lo, float hi) {
+    return (x < lo) ? lo : ((x > hi) ? hi : x);
+}
+
+constexpr unsigned char lutByte(float x) {
+    return (unsigned char)(lutClamp(x, 0.f, 1.f) * 255.f + .5f);
+}
+
+constexpr float lutFloor(float x) {
+    return (float)(int)x - (((float)(int)x > x) ? 1.f : 0.f);
+}
+
+// position of entry i along the table:
+constexpr float lutT(int i, int n) {
+    return (n > 1) ? (float)i / (n - 1) : 0.f;
+}
+
+// MARK: HSV sweeps
+
+// same closed form as HsvRgbBatch(): channel n (5, 3, 1 for r, g, b) at hue h in sextants (0..6)
+constexpr float lutHsvK(float n, float h) {
+    return (n + h >= 6.f) ? n + h - 6.f : n + h;
+}
+
+constexpr float lutHsvChannel(float n, float h, float s, float v) {
+    return v - v * s * lutClamp((lutHsvK(n, h) < 4.f - lutHsvK(n, h)) ? lutHsvK(n, h) : 4.f - lutHsvK(n, h), 0.f, 1.f);
+}
+
+// hue in degrees (any value) to sextants:
+constexpr float lutSextant(float degrees) {
+    return degrees / 60.f - 6.f * lutFloor(degrees / 360.f);
+}
+
+template <int N, int... I>
+constexpr ColorLut<N> hsvSweep(float h0, float h1, float s, float v, unsigned char alpha, LutIndices<I...>) {
+    return ColorLut<N>{ { { lutByte(lutHsvChannel(5.f, lutSextant(h0 + lutT(I, N) * (h1 - h0)), s, v)),
+                            lutByte(lutHsvChannel(3.f, lutSextant(h0 + lutT(I, N) * (h1 - h0)), s, v)),
+                            lutByte(lutHsvChannel(1.f, lutSextant(h0 + lutT(I, N) * (h1 - h0)), s, v)),
+                            alpha }... } };
+}
+
+// MARK: Gradients
+
+constexpr float stopChannel(const ColorStop &stop, int ch) {
+    return (ch == 0) ? stop.r : ((ch == 1) ? stop.g : stop.b);
+}
+
+constexpr float lerpStops(const ColorStop &a, const ColorStop &b, float t, int ch) {
+    return stopChannel(a, ch) + (stopChannel(b, ch) - stopChannel(a, ch)) *
+           ((b.t > a.t) ? lutClamp((t - a.t) / (b.t - a.t), 0.f, 1.f) : 1.f);
+}
+
+// channel ch at t, searching the stops from i on for the pair around t:
+constexpr float gradientChannel(const ColorStop *stops, int count, int i, float t, int ch) {
+    return (i + 2 >= count || t <= stops[i + 1].t) ? lerpStops(stops[i], stops[i + 1], t, ch)
+                                                   : gradientChannel(stops, count, i + 1, t, ch);
+}
+
+template <int N, int S, int... I>
+constexpr ColorLut<N> gradient(const ColorStop (&stops)[S], unsigned char alpha, LutIndices<I...>) {
+    return ColorLut<N>{ { { lutByte(gradientChannel(stops, S, 0, lutT(I, N), 0)),
+                            lutByte(gradientChannel(stops, S, 0, lutT(I, N), 1)),
+                            lutByte(gradientChannel(stops, S, 0, lutT(I, N), 2)),
+                            alpha }... } };
+}
+
+
+// MARK: - Tables
+
+// N entries sweeping hue from h0 to h1 degrees (either way round, past 360 is fine) at fixed s and v:
+template <int N>
+constexpr ColorLut<N> HsvSweepLut(float h0, float h1, float s, float v, unsigned char alpha) {
+    return hsvSweep<N>(h0, h1, s, v, alpha, typename MakeLutIndices<N>::type());
+}
+
+// N entries blending linearly between the stops (at least two; the ends hold past the first and last):
+template <int N, int S>
+constexpr ColorLut<N> GradientLut(const ColorStop (&stops)[S], unsigned char alpha) {
+    static_assert(S >= 2, "a gradient needs two stops");
+    return gradient<N>(stops, alpha, typename MakeLutIndices<N>::type());
+}
+
+#endif /* palette_hpp */
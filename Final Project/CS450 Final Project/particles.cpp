@@ -8,6 +8,9 @@
 
 #include "particles.hpp"
 
+// the snapshots go round three buffers, so the renderer always has a whole one:
+#define SNAPSHOT_FRESH  4   // set on latestSnapshot until the renderer takes it
+
 
 #ifdef _WIN32
 #define drand48() ((float)rand()/RAND_MAX)
@@ -38,46 +41,36 @@ PSparticle* particles = NULL;
 
 int numParticles = 10000;
 int particleSize = 20;
-float frame_time = 0;
-float flow = 500;
+std::atomic<float> flow(500);
 float sphereRadius = 1;
+std::atomic<int> burst(0);  // extra particles to release on the next step
+bool particleHue = false;   // color by height instead of the flat teal
 
-void setSphereRadius(float rad) {
-    sphereRadius = rad;
-}
+// live particle positions as of a finished step, for the renderer:
+typedef struct {
+    int live;
+    float *positions;
+} ParticleSnapshot;
 
-/* timedelta: returns the number of seconds that have elapsed since
- the previous call to the function. */
-#if defined(_WIN32)
-#include <sys/timeb.h>
-#else
-#include <limits.h>
-#include <unistd.h>
-#include <sys/types.h>
-#include <sys/times.h>
-#endif
+ParticleSnapshot snapshots[3];
+std::atomic<int> latestSnapshot(0);     // the newest one, | SNAPSHOT_FRESH if not yet taken
+int backSnapshot = 1;                   // the simulation's to fill
+int frontSnapshot = 2;                  // the renderer's to draw
 
-#ifndef CLK_TCK
-#define CLK_TCK 1000
-#endif
+// the original height*128 red ramp over teal, which now holds its top color above height 2:
+constexpr ColorStop particleStops[] = { {0., 0., .5, .5}, {1., 1., .5, .5} };
+constexpr ColorLut<256> ParticleLut = GradientLut<256>(particleStops, 80);
 
-float timedelta(void) {
-    static long begin = 0;
-    static long finish, difference;
-    
-#if defined(_WIN32)
-    static struct timeb tb;
-    ftime(&tb);
-    finish = tb.time*1000+tb.millitm;
-#else
-    static struct tms tb;
-    finish = times(&tb);
-#endif
-    
-    difference = finish - begin;
-    begin = finish;
-    
-    return (float)difference/(float)CLK_TCK;
+// hue by height for every live particle, converted together each frame:
+float *particleHsv = NULL;
+unsigned char *particleRgba = NULL;
+
+// eye depth sort keys and the draw order they give, rebuilt each frame:
+uint64_t *particleKeys = NULL, *particleKeyScratch = NULL;
+uint32_t *particleOrder = NULL, *particleOrderScratch = NULL;
+
+void setSphereRadius(float rad) {
+    sphereRadius = rad;
 }
 
 int fequal(float a, float b) {
@@ -195,68 +188,92 @@ void reshape(int width, int height) {
     glMatrixMode(GL_MODELVIEW);
     glLoadIdentity();
     gluLookAt(0, 1, 3, 0, 1, 0, 0, 1, 0);
-    glFogfv(GL_FOG_COLOR, black);
-    glFogf(GL_FOG_START, 2.5);
-    glFogf(GL_FOG_END, 4);
-    glEnable(GL_FOG);
-    glFogi(GL_FOG_MODE, GL_LINEAR);
-    glPointSize(particleSize);
-    glEnable(GL_POINT_SMOOTH);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glEnable(GL_COLOR_MATERIAL);
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_LIGHT0);
-    
-    timedelta();
+    stateFogfv(GL_FOG_COLOR, black);
+    stateFogf(GL_FOG_START, 2.5);
+    stateFogf(GL_FOG_END, 4);
+    stateEnable(GL_FOG);
+    stateFogi(GL_FOG_MODE, GL_LINEAR);
+    statePointSize(particleSize);
+    stateEnable(GL_POINT_SMOOTH);
+    stateEnable(GL_BLEND);
+    stateBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    stateEnable(GL_COLOR_MATERIAL);
+    stateEnable(GL_DEPTH_TEST);
+    stateEnable(GL_LIGHT0);
 }
 
 void drawParticles() {
-    static float c;
+    PROFILE_ZONE("Particles");
+    
+    // the newest finished step, if there is one since the last frame
+    if (latestSnapshot.load() & SNAPSHOT_FRESH)
+        frontSnapshot = latestSnapshot.exchange(frontSnapshot) & ~SNAPSHOT_FRESH;
+    ParticleSnapshot *snap = &snapshots[frontSnapshot];
+    
+    // one batch for all the colors, read back below in the same order
+    if (particleHue) {
+        for (int i = 0; i < snap->live; i++) {
+            float *hsv = &particleHsv[3 * i];
+            hsv[0] = 40. * snap->positions[3*i + 1];
+            hsv[1] = .7;
+            hsv[2] = 1.;
+        }
+        HsvRgba8Batch(particleHsv, particleRgba, snap->live, 80);
+    }
+    
+    // back to front, so each point blends over the ones behind it (eye z
+    // runs negative into the screen, so the farthest sorts first)
+    GLfloat m[16];
+    glGetFloatv(GL_MODELVIEW_MATRIX, m);
+    for (int i = 0; i < snap->live; i++) {
+        float *position = &snap->positions[3 * i];
+        particleKeys[i] = sortableFloat(m[2]*position[0] + m[6]*position[1] + m[10]*position[2] + m[14]);
+        particleOrder[i] = i;
+    }
+    RadixSort(particleKeys, particleOrder, particleKeyScratch, particleOrderScratch, snap->live);
     
     glPushMatrix();
     
         glBegin(GL_POINTS);
-        for (int i = 0; i < numParticles; i++) {
-            if (!particles[i].alive) continue;
-            c = particles[i].position[1]/2.1*255;
-            float height = fabs(particles[i].position[1]);
+        for (int j = 0; j < snap->live; j++) {
+            int i = particleOrder[j];
+            float *position = &snap->positions[3 * i];
+            float height = fabs(position[1]);
             
-            glColor4ub(height*128, 128, 128, 80);
-            glVertex3fv(particles[i].position);
+            if (particleHue)
+                glColor4ubv(&particleRgba[4 * i]);
+            else
+                glColor4ubv(ParticleLut(height / 2.));
+            glVertex3fv(position);
         }
         glEnd();
+        profileCount(COUNT_DRAW_CALLS, 1);
+        profileCount(COUNT_PARTICLES, snap->live);
     
     glPopMatrix();
 }
 
-void idleParticles(void) {
+/* stepParticles: advance the system by dt (a fixed tick, on the simulation thread)
+ and publish the live particles for the renderer */
+void stepParticles(float dt) {
     static int i;
     static int living = 0;  /* index to end of live particles */
-    static float dt;
-    
-    dt = timedelta();
-    frame_time += dt;
-    
-#if 1
-    /* slow the simulation if we can't keep the frame rate up around 10 fps */
-    static float slow_down = 1;
-    if (dt > 0.1) {
-        slow_down = 1.0/(100*dt);
-    } else if (dt < 0.1) {
-        slow_down = 1;
-    }
-    dt *= slow_down;
-#endif
+    static float owed = 0;  /* part of a particle, carried to the next step */
     
-    /* resurrect a few particles */
-    for (i = 0; i < flow * dt; i++) {
+    /* resurrect a few particles (plus any burst requested since the last step) */
+    owed += flow * dt;
+    int released = (int)owed;
+    owed -= released;
+    released = std::min(released + burst.exchange(0), numParticles);
+    for (i = 0; i < released; i++) {
         psNewParticle(&particles[living], dt);
         living++;
         if (living >= numParticles)
             living = 0;
     }
     
+    ParticleSnapshot *snap = &snapshots[backSnapshot];
+    snap->live = 0;
     for (i = 0; i < numParticles; i++) {
         psTimeStep(&particles[i], dt);
         
@@ -273,9 +290,17 @@ void idleParticles(void) {
             fequal(particles[i].velocity[1], 0)) {
             particles[i].alive = 0;
         }
+        
+        if (particles[i].alive)
+            memcpy(&snap->positions[3 * snap->live++], particles[i].position, 3 * sizeof(float));
     }
     
-    glutPostRedisplay();
+    backSnapshot = latestSnapshot.exchange(backSnapshot | SNAPSHOT_FRESH) & ~SNAPSHOT_FRESH;
+}
+
+/* burstParticles: release a clump of particles on the next step, e.g. on a beat */
+void burstParticles(int count) {
+    burst += count;
 }
 
 void DoParticleMenu(int id) {
@@ -283,36 +308,51 @@ void DoParticleMenu(int id) {
             
         case '+':
             // increase flow
-            flow += 100;
+            flow = flow + 100;
             if (flow > numParticles)
                 flow = numParticles;
-            printf("%g particles/second\n", flow);
+            printf("%g particles/second\n", flow.load());
             break;
             
         case '-':
             // decrease flow
-            flow -= 100;
+            flow = flow - 100;
             if (flow < 0)
                 flow = 0;
-            printf("%g particles/second\n", flow);
+            printf("%g particles/second\n", flow.load());
+            break;
+            
+        case 'h':
+            // color by height
+            particleHue = !particleHue;
             break;
     }
 }
 
-void menustate(int state) {
-    /* hook up a fake time delta to avoid jumping when menu comes up */
-    if (state == GLUT_MENU_NOT_IN_USE)
-        timedelta();
-}
-
 void cleanParticles() {
     puts("Cleaning particles resources");
     
     free(particles);
+    free(particleHsv);
+    free(particleRgba);
+    free(particleKeys);
+    free(particleKeyScratch);
+    free(particleOrder);
+    free(particleOrderScratch);
+    for (int s = 0; s < 3; s++)
+        free(snapshots[s].positions);
 }
 
 void InitParticles() {
     particles = (PSparticle*)malloc(sizeof(PSparticle) * numParticles);
+    particleHsv = (float*)malloc(3 * sizeof(float) * numParticles);
+    particleRgba = (unsigned char*)malloc(4 * numParticles);
+    particleKeys = (uint64_t*)malloc(sizeof(uint64_t) * numParticles);
+    particleKeyScratch = (uint64_t*)malloc(sizeof(uint64_t) * numParticles);
+    particleOrder = (uint32_t*)malloc(sizeof(uint32_t) * numParticles);
+    particleOrderScratch = (uint32_t*)malloc(sizeof(uint32_t) * numParticles);
+    for (int s = 0; s < 3; s++)
+        snapshots[s].positions = (float*)malloc(3 * sizeof(float) * numParticles);
     
     atexit(cleanParticles);
 }
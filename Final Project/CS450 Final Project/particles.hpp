@@ -24,6 +24,13 @@
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
+#include <algorithm>
+#include <atomic>
+#include "utility_funcs.hpp"
+#include "palette.hpp"
+#include "profiler.hpp"
+#include "gl_state.hpp"
+#include "render_queue.hpp"
 
 
 #pragma GCC diagnostic ignored "-Wdeprecated-declarations"
@@ -35,11 +42,11 @@ void InitParticles();
 
 void drawParticles();
 
-void menustate(int state);
 void reshape(int width, int height);
 
 void DoParticleMenu(int id);
 
-void idleParticles();
+void stepParticles(float dt);
+void burstParticles(int count);
 
 #endif /* particles_hpp */
@@ -0,0 +1,302 @@
+//
+//  profiler.cpp
+//  CS450 Final Project
+//
+//  Per-stage frame timing. A zone is a name under a parent zone, so the same
+//  name opened in two places is two zones. Each zone adds up its CPU time over
+//  a frame (however many times it is opened), and ProfileFrame() moves those
+//  totals into a ring of the last PROFILE_WINDOW frames it ran in. The stats
+//  are worked out from the ring when they are asked for. GPU times come back
+//  a few frames late (PROFILE_GPU_FRAMES), so the render thread never waits on them.
+//
+
+#include "profiler.hpp"
+
+// GL_TIME_ELAPSED queries (EXT_timer_query, core in GL 3.3):
+#ifdef GL_TIME_ELAPSED_EXT
+#define PROFILE_GPU
+#endif
+
+typedef std::chrono::steady_clock ProfileClock;
+
+typedef struct {
+    const char *name;
+    int parent, depth;
+    double frameMs;                         // CPU time so far this frame
+    int calls;                              // times opened this frame
+    float cpu[PROFILE_WINDOW];              // ring of per-frame CPU ms
+    int cpuHead, cpuCount;
+    float gpu[PROFILE_WINDOW];              // ring of GPU ms, as they come back
+    int gpuHead, gpuCount;
+    GLuint queries[PROFILE_GPU_FRAMES];     // one per frame in flight
+    bool issued[PROFILE_GPU_FRAMES];
+} ProfileZone;
+
+// an open zone:
+typedef struct {
+    int zone;
+    ProfileClock::time_point start;
+    bool gpu;                               // a timer query is running for it
+} ProfileMark;
+
+bool                    ProfileOn;
+
+ProfileZone             zones[PROFILE_MAX_ZONES];
+int                     numZones = 0;
+ProfileMark             marks[PROFILE_MAX_DEPTH];
+int                     markDepth = 0;
+
+float                   frameTimes[PROFILE_WINDOW];    // ring of frame to frame ms
+int                     frameHead = 0;
+int                     frameCount = 0;
+ProfileClock::time_point lastFrame;
+bool                    haveLastFrame = false;
+unsigned                profileFrameNumber = 0;
+int                     counts[PROFILE_COUNTERS];      // this frame so far
+int                     lastCounts[PROFILE_COUNTERS];  // the last whole frame
+bool                    gpuTimers = false;
+
+void cleanProfiler() {
+    puts("Cleaning profiler resources");
+
+#ifdef PROFILE_GPU
+    if (gpuTimers)
+        for (int z = 0; z < numZones; z++)
+            glDeleteQueries(PROFILE_GPU_FRAMES, zones[z].queries);
+#endif
+    numZones = 0;
+}
+
+// needs the GL context, to see whether timer queries are there:
+void InitProfiler() {
+    ProfileOn = true;
+
+#ifdef PROFILE_GPU
+    const char *ext = (const char*)glGetString(GL_EXTENSIONS);
+    gpuTimers = ext && (strstr(ext, "GL_EXT_timer_query") || strstr(ext, "GL_ARB_timer_query"));
+#endif
+    if (!gpuTimers)
+        fprintf(stderr, "Profiler: no GL timer queries, CPU times only\n");
+
+    atexit(cleanProfiler);
+}
+
+static void pushSample(float *ring, int *head, int *count, float ms) {
+    ring[*head] = ms;
+    *head = (*head + 1) % PROFILE_WINDOW;
+    if (*count < PROFILE_WINDOW) (*count)++;
+}
+
+// the zone for name under parent, made on first use (-1 once the table is full):
+int findZone(const char *name, int parent) {
+    for (int z = 0; z < numZones; z++)
+        if (zones[z].parent == parent && (zones[z].name == name || strcmp(zones[z].name, name) == 0))
+            return z;
+    if (numZones == PROFILE_MAX_ZONES) return -1;
+
+    ProfileZone *zone = &zones[numZones];
+    memset(zone, 0, sizeof(ProfileZone));
+    zone->name = name;
+    zone->parent = parent;
+    zone->depth = (parent < 0) ? 0 : zones[parent].depth + 1;
+#ifdef PROFILE_GPU
+    if (gpuTimers && zone->depth == 0)
+        glGenQueries(PROFILE_GPU_FRAMES, zone->queries);
+#endif
+    return numZones++;
+}
+
+#ifdef PROFILE_GPU
+// collect the time from this slot's last query, if it has finished (else it is dropped):
+static void readQuery(ProfileZone *zone, int slot) {
+    if (!zone->issued[slot]) return;
+    zone->issued[slot] = false;
+
+    GLint ready = 0;
+    glGetQueryObjectiv(zone->queries[slot], GL_QUERY_RESULT_AVAILABLE, &ready);
+    if (!ready) return;
+    GLuint64EXT ns = 0;
+    glGetQueryObjectui64vEXT(zone->queries[slot], GL_QUERY_RESULT, &ns);
+    pushSample(zone->gpu, &zone->gpuHead, &zone->gpuCount, (float)(ns / 1e6));
+}
+#endif
+
+// counted whether or not the profiler is on (they are only additions):
+void profileCount(int counter, int n) {
+    counts[counter] += n;
+}
+
+// counter over the last whole frame:
+int profileCounter(int counter) {
+    return lastCounts[counter];
+}
+
+// open a zone inside the innermost open one (-1 if not profiling):
+int profileBegin(const char *name) {
+    traceBegin(name);
+    if (!ProfileOn || markDepth == PROFILE_MAX_DEPTH) return -1;
+
+    int z = findZone(name, markDepth ? marks[markDepth-1].zone : -1);
+    if (z < 0) return -1;
+
+    ProfileMark *mark = &marks[markDepth++];
+    mark->zone = z;
+    mark->gpu = false;
+#ifdef PROFILE_GPU
+    // first opening of a top level zone this frame
+    if (gpuTimers && zones[z].depth == 0 && zones[z].calls == 0) {
+        int slot = profileFrameNumber % PROFILE_GPU_FRAMES;
+        readQuery(&zones[z], slot);
+        glBeginQuery(GL_TIME_ELAPSED_EXT, zones[z].queries[slot]);
+        mark->gpu = true;
+    }
+#endif
+    mark->start = ProfileClock::now();
+    return z;
+}
+
+void profileEnd(int zone) {
+    traceEnd();
+    if (zone < 0 || markDepth == 0 || marks[markDepth-1].zone != zone) return;
+
+    ProfileMark *mark = &marks[--markDepth];
+    zones[zone].frameMs += std::chrono::duration<double, std::milli>(ProfileClock::now() - mark->start).count();
+    zones[zone].calls++;
+#ifdef PROFILE_GPU
+    if (mark->gpu) {
+        glEndQuery(GL_TIME_ELAPSED_EXT);
+        zones[zone].issued[profileFrameNumber % PROFILE_GPU_FRAMES] = true;
+    }
+#endif
+}
+
+/**
+ ** call once a frame (after the buffer swap): files this frame's zone totals,
+ ** counters and the time since the last call
+ **/
+void ProfileFrame() {
+    memcpy(lastCounts, counts, sizeof(counts));
+    memset(counts, 0, sizeof(counts));
+
+    if (!ProfileOn) {
+        haveLastFrame = false;
+        return;
+    }
+
+    ProfileClock::time_point now = ProfileClock::now();
+    if (haveLastFrame)
+        pushSample(frameTimes, &frameHead, &frameCount, std::chrono::duration<float, std::milli>(now - lastFrame).count());
+    lastFrame = now;
+    haveLastFrame = true;
+
+    for (int z = 0; z < numZones; z++) {
+        ProfileZone *zone = &zones[z];
+        if (zone->calls == 0) continue;     // stages that are off do not count against themselves
+        pushSample(zone->cpu, &zone->cpuHead, &zone->cpuCount, (float)zone->frameMs);
+        zone->frameMs = 0;
+        zone->calls = 0;
+    }
+    profileFrameNumber++;
+}
+
+
+// MARK: - Stats
+
+static ProfileStats ringStats(const float *ring, int count) {
+    ProfileStats stats = { 0, 0, 0, 0, count };
+    if (count == 0) return stats;
+
+    float sorted[PROFILE_WINDOW];
+    memcpy(sorted, ring, count * sizeof(float));
+    float sum = 0;
+    for (int i = 0; i < count; i++) sum += sorted[i];
+    stats.avg = sum / count;
+    stats.min = *std::min_element(sorted, sorted + count);
+    stats.max = *std::max_element(sorted, sorted + count);
+    int k = (int)(.99f * (count - 1) + 0.5f);
+    std::nth_element(sorted, sorted + k, sorted + count);
+    stats.p99 = sorted[k];
+    return stats;
+}
+
+int profileZoneCount() {
+    return numZones;
+}
+
+const char* profileZoneName(int zone) {
+    return zones[zone].name;
+}
+
+int profileZoneDepth(int zone) {
+    return zones[zone].depth;
+}
+
+ProfileStats profileCpuStats(int zone) {
+    return ringStats(zones[zone].cpu, zones[zone].cpuCount);
+}
+
+ProfileStats profileGpuStats(int zone) {
+    return ringStats(zones[zone].gpu, zones[zone].gpuCount);
+}
+
+ProfileStats profileFrameStats() {
+    return ringStats(frameTimes, frameCount);
+}
+
+// frame to frame ms, 0 the latest (0. past the window):
+float profileFrameTime(int ago) {
+    if (ago < 0 || ago >= frameCount) return 0.;
+    return frameTimes[(frameHead - 1 - ago + PROFILE_WINDOW) % PROFILE_WINDOW];
+}
+
+// frames in the window by whole milliseconds; returns how many frames there are
+int profileHistogram(int bins[PROFILE_HIST_BINS]) {
+    memset(bins, 0, PROFILE_HIST_BINS * sizeof(int));
+    for (int i = 0; i < frameCount; i++)
+        bins[std::min((int)frameTimes[i], PROFILE_HIST_BINS - 1)]++;
+    return frameCount;
+}
+
+bool profileGpuTimers() {
+    return gpuTimers;
+}
+
+// zones in call order (children under their parents):
+static void printZone(int parent) {
+    for (int z = 0; z < numZones; z++) {
+        if (zones[z].parent != parent) continue;
+        ProfileStats cpu = profileCpuStats(z);
+        fprintf(stderr, "  %*s%-*s  cpu %6.2f %6.2f %6.2f", 2 * zones[z].depth, "", 16 - 2 * zones[z].depth,
+                zones[z].name, cpu.min, cpu.avg, cpu.p99);
+        if (zones[z].gpuCount) {
+            ProfileStats gpu = profileGpuStats(z);
+            fprintf(stderr, "   gpu %6.2f %6.2f %6.2f", gpu.min, gpu.avg, gpu.p99);
+        }
+        fprintf(stderr, "\n");
+        printZone(z);
+    }
+}
+
+void printProfileReport() {
+    ProfileStats frame = profileFrameStats();
+    fprintf(stderr, "Frame time over %d frames (ms): min %.2f  avg %.2f  p99 %.2f  max %.2f\n",
+            frame.samples, frame.min, frame.avg, frame.p99, frame.max);
+    fprintf(stderr, "  %-16s      %6s %6s %6s", "zone", "min", "avg", "p99");
+    if (gpuTimers) fprintf(stderr, "       %6s %6s %6s", "min", "avg", "p99");
+    fprintf(stderr, "\n");
+    printZone(-1);
+
+    int bins[PROFILE_HIST_BINS];
+    int count = profileHistogram(bins);
+    int most = *std::max_element(bins, bins + PROFILE_HIST_BINS);
+    if (count == 0) return;
+    for (int b = 0; b < PROFILE_HIST_BINS; b++) {
+        if (bins[b] == 0) continue;
+        char bar[41];
+        int len = (bins[b] * 40 + most - 1) / most;
+        memset(bar, '#', len);
+        bar[len] = '\0';
+        if (b == PROFILE_HIST_BINS - 1) fprintf(stderr, "  %3d+ ms %5d %s\n", b, bins[b], bar);
+        else                            fprintf(stderr, "  %3d ms  %5d %s\n", b, bins[b], bar);
+    }
+}
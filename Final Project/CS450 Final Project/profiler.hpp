@@ -0,0 +1,95 @@
+//
+//  profiler.hpp
+//  CS450 Final Project
+//
+
+#ifndef profiler_hpp
+#define profiler_hpp
+
+#ifdef WIN32
+#include <windows.h>
+#pragma warning(disable:4996)
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <GL/glu.h>
+#include <GL/glut.h>
+#else
+#include <GLUT/glut.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include "trace.hpp"
+
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+
+// distinct zones (a name under a given parent), and how deep they can nest:
+#define PROFILE_MAX_ZONES   32
+#define PROFILE_MAX_DEPTH   8
+// frames in the sliding window the stats are taken over (4 s at 60 fps):
+#define PROFILE_WINDOW      240
+// frames a GPU timer is given to finish before its result is read back:
+#define PROFILE_GPU_FRAMES  4
+// frame time histogram: 1 ms bins, the last one catches everything slower
+#define PROFILE_HIST_BINS   34
+
+// things the renderers count up over a frame:
+enum ProfileCounters {
+    COUNT_DRAW_CALLS,       // glBegin/glDrawArrays/glCallList(s)
+    COUNT_SPHERE_VERTICES,
+    COUNT_PARTICLES,        // live particles drawn
+    COUNT_STATE_ISSUED,     // state calls through the state cache that reached GL
+    COUNT_STATE_SUPPRESSED, // and those it dropped as redundant
+    COUNT_MATERIAL_CHANGES, // material setups run by the render queue
+    PROFILE_COUNTERS
+};
+
+// milliseconds over the window:
+typedef struct {
+    float min, avg, p99, max;
+    int samples;
+} ProfileStats;
+
+extern bool ProfileOn;
+
+void InitProfiler();
+void ProfileFrame();
+
+void profileCount(int counter, int n);
+int profileCounter(int counter);
+
+int profileBegin(const char *name);
+void profileEnd(int zone);
+
+/**
+ ** times the enclosing block as a zone, nested inside whichever zone is open:
+ **     { PROFILE_ZONE("Sphere"); MjbSphere(...); }
+ ** zones at the top level are also timed on the GPU when timer queries exist
+ ** (only one GL_TIME_ELAPSED query can run at a time, so nested ones are CPU only);
+ ** the render thread only. Every zone is traced too, whether or not the profiler is on
+ **/
+class ProfileScope {
+    int zone;
+public:
+    explicit ProfileScope(const char *name) : zone(profileBegin(name)) {}
+    ~ProfileScope() { profileEnd(zone); }
+};
+#define PROFILE_CONCAT2(a, b)   a##b
+#define PROFILE_CONCAT(a, b)    PROFILE_CONCAT2(a, b)
+#define PROFILE_ZONE(name)      ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+
+int profileZoneCount();
+const char* profileZoneName(int zone);
+int profileZoneDepth(int zone);
+ProfileStats profileCpuStats(int zone);
+ProfileStats profileGpuStats(int zone);
+ProfileStats profileFrameStats();
+float profileFrameTime(int ago);
+int profileHistogram(int bins[PROFILE_HIST_BINS]);
+bool profileGpuTimers();
+
+void printProfileReport();
+
+#endif /* profiler_hpp */
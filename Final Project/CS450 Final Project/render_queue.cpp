@@ -0,0 +1,137 @@
+//
+//  render_queue.cpp
+//  CS450 Final Project
+//
+//  The frame's draws are queued rather than made as Display() comes to them.
+//  Each carries a 64 bit key packing its pass, material, texture and depth, so
+//  once they are radix sorted the draws sharing a material (the state a draw
+//  needs: lighting, blending, depth writes...) and texture run together and
+//  each material is set up once. Opaque draws run front to back, to fail the
+//  depth test early; blended ones back to front, so they blend over what is
+//  behind them; overlays last, in the order they came.
+//
+//  A draw keeps the modelview it was submitted under (and is given it back),
+//  but not the projection: a draw that changes that belongs in the overlay pass.
+//
+
+#include "render_queue.hpp"
+
+typedef struct {
+    RenderFunc draw;
+    const void *data;
+    mat4 modelview;
+} RenderCommand;
+
+RenderCommand renderCommands[RENDER_MAX_COMMANDS];
+uint64_t renderKeys[RENDER_MAX_COMMANDS], renderKeyScratch[RENDER_MAX_COMMANDS];
+uint32_t renderOrder[RENDER_MAX_COMMANDS], renderOrderScratch[RENDER_MAX_COMMANDS];
+int renderCount = 0;
+
+void (*renderMaterials[RENDER_MAX_MATERIALS])() = { NULL };
+
+// material's state setup, run before the first of its draws in each run of them:
+void setRenderMaterial(int material, void (*apply)()) {
+    if (material >= 0 && material < RENDER_MAX_MATERIALS)
+        renderMaterials[material] = apply;
+}
+
+/**
+ ** queues draw(data) under the current modelview; texture is anything that
+ ** tells the draw's textures apart (0 for none), and center (in modelview
+ ** coordinates) places it in depth among the others in its pass
+ **/
+void submitDraw(int pass, int material, int texture, vec3 center, RenderFunc draw, const void *data) {
+    if (renderCount == RENDER_MAX_COMMANDS) {
+        fprintf(stderr, "Render queue full, drawing straight away\n");
+        if (renderMaterials[material] != NULL) renderMaterials[material]();
+        draw(data);
+        return;
+    }
+
+    RenderCommand *command = &renderCommands[renderCount];
+    command->draw = draw;
+    command->data = data;
+    GLfloat m[16];
+    glGetFloatv(GL_MODELVIEW_MATRIX, m);
+    command->modelview = mat4(m);
+
+    // distance in front of the eye; overlays just keep their place in line
+    uint32_t depth;
+    if (pass == PASS_OVERLAY)
+        depth = renderCount;
+    else {
+        depth = sortableFloat(-transformPoint(command->modelview, center).z);
+        if (pass == PASS_BLENDED) depth = ~depth;
+    }
+
+    renderKeys[renderCount] = ((uint64_t)pass << RENDER_PASS_SHIFT)
+                            | ((uint64_t)material << RENDER_MATERIAL_SHIFT)
+                            | ((uint64_t)(texture & RENDER_TEXTURE_MASK) << RENDER_TEXTURE_SHIFT)
+                            | depth;
+    renderOrder[renderCount] = renderCount;
+    renderCount++;
+}
+
+// sorts and runs everything queued since the last call, then empties the queue:
+void ExecuteRenderQueue() {
+    RadixSort(renderKeys, renderOrder, renderKeyScratch, renderOrderScratch, renderCount);
+
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    int material = -1;
+    for (int i = 0; i < renderCount; i++) {
+        int next = (int)(renderKeys[i] >> RENDER_MATERIAL_SHIFT) & (RENDER_MAX_MATERIALS - 1);
+        if (next != material) {
+            material = next;
+            if (renderMaterials[material] != NULL) renderMaterials[material]();
+            profileCount(COUNT_MATERIAL_CHANGES, 1);
+        }
+
+        RenderCommand *command = &renderCommands[renderOrder[i]];
+        glLoadMatrixf(command->modelview);
+        command->draw(command->data);
+    }
+    glPopMatrix();
+
+    // (a material may turn depth writes off, and the next clear needs them)
+    stateDepthMask(GL_TRUE);
+    renderCount = 0;
+}
+
+/**
+ ** sorts n keys ascending, carrying values along, a byte at a time from the
+ ** lowest (stable, so equal keys keep their order). Bytes every key shares
+ ** are skipped, so narrow keys cost only the passes they need. The sorted
+ ** result ends up back in keys and values
+ **/
+void RadixSort(uint64_t *keys, uint32_t *values, uint64_t *keyScratch, uint32_t *valueScratch, int n) {
+    if (n < 2) return;
+
+    uint64_t *fromKeys = keys, *toKeys = keyScratch;
+    uint32_t *fromValues = values, *toValues = valueScratch;
+    for (int shift = 0; shift < 64; shift += 8) {
+        int counts[256] = { 0 };
+        for (int i = 0; i < n; i++)
+            counts[(fromKeys[i] >> shift) & 0xFF]++;
+        if (counts[(fromKeys[0] >> shift) & 0xFF] == n) continue;
+
+        int offset = 0;
+        for (int b = 0; b < 256; b++) {
+            int count = counts[b];
+            counts[b] = offset;
+            offset += count;
+        }
+        for (int i = 0; i < n; i++) {
+            int slot = counts[(fromKeys[i] >> shift) & 0xFF]++;
+            toKeys[slot] = fromKeys[i];
+            toValues[slot] = fromValues[i];
+        }
+        std::swap(fromKeys, toKeys);
+        std::swap(fromValues, toValues);
+    }
+
+    if (fromKeys != keys) {
+        memcpy(keys, fromKeys, n * sizeof(uint64_t));
+        memcpy(values, fromValues, n * sizeof(uint32_t));
+    }
+}
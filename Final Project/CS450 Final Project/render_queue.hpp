@@ -0,0 +1,62 @@
+//
+//  render_queue.hpp
+//  CS450 Final Project
+//
+
+#ifndef render_queue_hpp
+#define render_queue_hpp
+
+#ifdef WIN32
+#include <windows.h>
+#pragma warning(disable:4996)
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <GL/glu.h>
+#include <GL/glut.h>
+#else
+#include <GLUT/glut.h>
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include "vecmath.hpp"
+#include "profiler.hpp"
+#include "gl_state.hpp"
+
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+
+// most draws queued in a frame, and most materials:
+#define RENDER_MAX_COMMANDS     64
+#define RENDER_MAX_MATERIALS    16
+
+// the sort key, high bits first: pass | material | texture | depth
+#define RENDER_PASS_SHIFT       60
+#define RENDER_MATERIAL_SHIFT   52
+#define RENDER_TEXTURE_SHIFT    32
+#define RENDER_TEXTURE_MASK     0xFFFFF
+
+// passes run in this order:
+enum RenderPass {
+    PASS_OPAQUE,    // front to back
+    PASS_BLENDED,   // back to front
+    PASS_OVERLAY    // on top, in the order submitted
+};
+
+typedef void (*RenderFunc)(const void *data);
+
+void setRenderMaterial(int material, void (*apply)());
+void submitDraw(int pass, int material, int texture, vec3 center, RenderFunc draw, const void *data);
+void ExecuteRenderQueue();
+
+void RadixSort(uint64_t *keys, uint32_t *values, uint64_t *keyScratch, uint32_t *valueScratch, int n);
+
+// a float's bits, flipped so they sort as unsigned integers in the float's order:
+inline uint32_t sortableFloat(float f) {
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return (u & 0x80000000u) ? ~u : (u | 0x80000000u);
+}
+
+#endif /* render_queue_hpp */
@@ -0,0 +1,152 @@
+//
+//  scheduler.cpp
+//  CS450 Final Project
+//
+//  Simulation and presentation on their own clocks. The simulation steps at a
+//  fixed SIM_HZ on a thread of its own, publishing what it made for the
+//  renderer to pick up (see the particle snapshots), so it no longer speeds up
+//  and slows down with the frame rate. The render loop waits for its next frame
+//  rather than spinning in the GLUT idle callback: it sleeps to a fixed grid of
+//  deadlines at TargetFps, or leaves the waiting to a vsynced buffer swap.
+//
+
+#include "scheduler.hpp"
+
+#if defined(__APPLE__)
+#include <OpenGL/OpenGL.h>
+#elif !defined(WIN32)
+#include <GL/glx.h>
+#endif
+
+typedef std::chrono::steady_clock SchedulerClock;
+
+// headless frames step the simulation a whole number of times:
+static_assert(SIM_HZ % HEADLESS_FPS == 0, "SIM_HZ must be a multiple of HEADLESS_FPS");
+
+int                         TargetFps;
+int                         Pacing;
+std::atomic<bool>           SimulationPaused(false);
+
+void                        (*simStep)(float dt) = NULL;
+std::thread                 simThread;
+std::atomic<bool>           stopSimulation(false);
+SchedulerClock::time_point  nextFrame;
+
+void simulationLoop() {
+    traceThreadName("Simulation");
+    const SchedulerClock::duration tick = std::chrono::nanoseconds(1000000000 / SIM_HZ);
+    SchedulerClock::time_point next = SchedulerClock::now();
+
+    while (!stopSimulation) {
+        std::this_thread::sleep_until(next);
+        SchedulerClock::time_point now = SchedulerClock::now();
+        if (SimulationPaused) {
+            next = now + tick;
+            continue;
+        }
+
+        // every tick that has come due (drop the backlog after a long stall)
+        if (now - next > SIM_MAX_CATCHUP * tick) next = now;
+        while (next <= now) {
+            TRACE_ZONE("Simulate");
+            simStep(SIM_DT);
+            next += tick;
+        }
+    }
+}
+
+void cleanScheduler() {
+    puts("Cleaning scheduler resources");
+
+    stopSimulation = true;
+    if (simThread.joinable()) simThread.join();
+}
+
+// starts stepping the simulation (headless frames step it themselves):
+void InitScheduler(void (*step)(float dt)) {
+    simStep = step;
+    TargetFps = TARGET_FPS;
+    SetFramePacing(PACE_SLEEP);
+
+    if (!Headless) simThread = std::thread(simulationLoop);
+
+    atexit(cleanScheduler);
+}
+
+// steps the simulation on this thread (headless, where the frame clock rules):
+void RunSimulationTicks(int ticks) {
+    for (int i = 0; i < ticks; i++) {
+        TRACE_ZONE("Simulate");
+        simStep(SIM_DT);
+    }
+}
+
+#if !defined(__APPLE__) && !defined(WIN32)
+// GLX hands out a pointer for any name, so look for the extension itself:
+static bool hasGlxExtension(Display *display, const char *name) {
+    const char *extensions = glXQueryExtensionsString(display, DefaultScreen(display));
+    size_t length = strlen(name);
+    for (const char *e = extensions; e != NULL && (e = strstr(e, name)) != NULL; e += length)
+        if ((e == extensions || e[-1] == ' ') && (e[length] == ' ' || e[length] == '\0')) return true;
+    return false;
+}
+#endif
+
+// 1 waits for the display on each buffer swap, 0 does not; false if it cannot be set:
+static bool setSwapInterval(int interval) {
+#if defined(__APPLE__)
+    GLint value = interval;
+    return CGLSetParameter(CGLGetCurrentContext(), kCGLCPSwapInterval, &value) == kCGLNoError;
+#elif defined(WIN32)
+    typedef BOOL (WINAPI *SwapIntervalProc)(int);
+    SwapIntervalProc swapInterval = (SwapIntervalProc)wglGetProcAddress("wglSwapIntervalEXT");
+    return swapInterval != NULL && swapInterval(interval);
+#else
+    Display *display = glXGetCurrentDisplay();
+    GLXDrawable drawable = glXGetCurrentDrawable();
+    if (display == NULL || drawable == None) return false;
+
+    if (hasGlxExtension(display, "GLX_EXT_swap_control")) {
+        typedef void (*SwapIntervalEXTProc)(Display*, GLXDrawable, int);
+        SwapIntervalEXTProc swapInterval =
+            (SwapIntervalEXTProc)glXGetProcAddressARB((const GLubyte*)"glXSwapIntervalEXT");
+        if (swapInterval != NULL) {
+            swapInterval(display, drawable, interval);
+            return true;
+        }
+    }
+    if (hasGlxExtension(display, "GLX_MESA_swap_control")) {
+        typedef int (*SwapIntervalMESAProc)(unsigned int);
+        SwapIntervalMESAProc swapInterval =
+            (SwapIntervalMESAProc)glXGetProcAddressARB((const GLubyte*)"glXSwapIntervalMESA");
+        if (swapInterval != NULL) return swapInterval(interval) == 0;
+    }
+    return false;
+#endif
+}
+
+// where the swap interval cannot be set, vsync pacing falls back to sleeping:
+void SetFramePacing(int pacing) {
+    Pacing = pacing;
+    if (!Headless && !setSwapInterval(pacing == PACE_VSYNC) && pacing == PACE_VSYNC) {
+        fprintf(stderr, "Cannot set the swap interval here, pacing by sleeping instead\n");
+        Pacing = PACE_SLEEP;
+    }
+    nextFrame = SchedulerClock::now();
+}
+
+/**
+ ** call at the top of the idle callback: returns when the next frame is due.
+ ** Deadlines sit on a fixed grid, so a late frame is made up by the next one
+ ** rather than pushing every later frame back; more than a frame late and the
+ ** grid starts again from now
+ **/
+void WaitForFrame() {
+    if (Headless || Pacing != PACE_SLEEP) return;
+
+    const SchedulerClock::duration period = std::chrono::nanoseconds(1000000000 / TargetFps);
+    SchedulerClock::time_point now = SchedulerClock::now();
+    if (now - nextFrame > period) nextFrame = now;
+    else std::this_thread::sleep_until(nextFrame);
+    nextFrame += period;
+}
@@ -0,0 +1,53 @@
+//
+//  scheduler.hpp
+//  CS450 Final Project
+//
+
+#ifndef scheduler_hpp
+#define scheduler_hpp
+
+#ifdef WIN32
+#include <windows.h>
+#pragma warning(disable:4996)
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <GL/glu.h>
+#include <GL/glut.h>
+#else
+#include <GLUT/glut.h>
+#endif
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "headless.hpp"
+#include "trace.hpp"
+
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+
+// simulation steps per second, whatever the frame rate:
+#define SIM_HZ              120
+#define SIM_DT              (1.f / SIM_HZ)
+// most steps run to catch up after a stall (past that, simulated time slips instead):
+#define SIM_MAX_CATCHUP     8
+// presentation rate when pacing by sleeping:
+#define TARGET_FPS          60
+
+// how the render loop waits for the next frame:
+enum FramePacing {
+    PACE_SLEEP,     // sleep to TargetFps
+    PACE_VSYNC,     // the buffer swap waits for the display
+    PACE_OFF        // as fast as it will go
+};
+
+extern int TargetFps;
+extern int Pacing;
+extern std::atomic<bool> SimulationPaused;
+
+void InitScheduler(void (*step)(float dt));
+void RunSimulationTicks(int ticks);
+void SetFramePacing(int pacing);
+void WaitForFrame();
+
+#endif /* scheduler_hpp */
@@ -0,0 +1,158 @@
+//
+//  spectrum_filter.cpp
+//  CS450 Final Project
+//
+//  Smoothing for the resampled spectra: a per-bin attack/release follower over
+//  the newest analysis, and a peak-hold stage over the spectrum being shown (for
+//  the sphere's peak rings). Both are SSE passes over aligned arena rows.
+//
+
+#include "spectrum_filter.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+bool    PeakHoldOn = false;
+float   attackTime = 0.01f;
+float   releaseTime = 0.15f;
+float   holdTime = 0.25f;
+float   fallRate = 0.1f;
+
+// reserve the filter state (smoothed spectrum, held peaks, hold timers) in the arena:
+void InitSpectrumFilter(int channels, int res) {
+    arenaReserve(ARENA_ENVELOPE, channels, res);
+    arenaReserve(ARENA_PEAK, channels, res);
+    arenaReserve(ARENA_HOLD, channels, res);
+}
+
+void setSmoothing(float attack, float release) {
+    attackTime = attack;
+    releaseTime = release;
+}
+
+void setPeakHold(float hold, float fall) {
+    holdTime = hold;
+    fallRate = fall;
+}
+
+// one-pole coefficient for a time constant over a step of dt seconds:
+static float coefficient(float tau, float dt) {
+    if (tau <= 0) return 1;
+    return 1 - expf(-dt / tau);
+}
+
+// run the asymmetric attack/release follower over every bin of every channel;
+// spec is replaced by the smoothed values (spec must be the arena's
+// ARENA_SPECTRUM rows so vectors stay aligned)
+void filterSpectrum(float **spec, int channels, int res, float dt) {
+    if (channels > arenaChannels(ARENA_ENVELOPE)) channels = arenaChannels(ARENA_ENVELOPE);
+    
+    // a new resolution starts the filter state over
+    if (arenaLength(ARENA_ENVELOPE) != res && !arenaResize(ARENA_ENVELOPE, res))
+        return;
+    float **envelope = arenaStage(ARENA_ENVELOPE);
+    
+    // the audio clock moves a mix block at a time (and not at all when paused),
+    // so many frames see no time pass: they get the last smoothed output again
+    if (dt <= 0) {
+        for (int c = 0; c < channels; c++)
+            memcpy(spec[c], envelope[c], res * sizeof(float));
+        return;
+    }
+
+    float att = coefficient(attackTime, dt);
+    float rel = coefficient(releaseTime, dt);
+
+    for (int c = 0; c < channels; c++) {
+        float *in = spec[c], *env = envelope[c];
+        int bin = 0;
+
+#ifdef __SSE2__
+        __m128 vatt = _mm_set1_ps(att), vrel = _mm_set1_ps(rel);
+        // arena rows are aligned and padded, so whole vectors can run past res
+        for (; bin < res; bin += 4) {
+            __m128 x = _mm_load_ps(&in[bin]);
+            __m128 e = _mm_load_ps(&env[bin]);
+
+            // rising bins use the attack coefficient, falling bins the release one
+            __m128 rising = _mm_cmpgt_ps(x, e);
+            __m128 k = _mm_or_ps(_mm_and_ps(rising, vatt), _mm_andnot_ps(rising, vrel));
+            e = _mm_add_ps(e, _mm_mul_ps(k, _mm_sub_ps(x, e)));
+
+            _mm_store_ps(&env[bin], e);
+            _mm_store_ps(&in[bin], e);
+        }
+#endif
+
+        // whole pass without SSE:
+        for (; bin < res; bin++) {
+            float x = in[bin];
+            float e = env[bin];
+            e += ((x > e) ? att : rel) * (x - e);
+            env[bin] = e;
+            in[bin] = e;
+        }
+    }
+}
+
+/**
+ ** the peak-hold stage, over the spectrum being shown (so the peaks line up with
+ ** what is heard, not with the newest analysis): a new peak is held for the
+ ** hold time, then falls at the fall rate until the spectrum catches it.
+ ** spec must be arena rows; returns the peaks, one row per channel
+ **/
+float** holdPeaks(float **spec, int channels, int res, float dt) {
+    if (channels > arenaChannels(ARENA_PEAK)) channels = arenaChannels(ARENA_PEAK);
+    
+    // a new resolution starts the peaks over
+    if (arenaLength(ARENA_PEAK) != res) {
+        if (!arenaResize(ARENA_PEAK, res) || !arenaResize(ARENA_HOLD, res))
+            return NULL;
+    }
+    float **peak = arenaStage(ARENA_PEAK);
+    float **holdLeft = arenaStage(ARENA_HOLD);
+    if (dt <= 0) return peak;
+
+    float fall = fallRate * dt;
+
+    for (int c = 0; c < channels; c++) {
+        float *in = spec[c], *pk = peak[c], *hl = holdLeft[c];
+        int bin = 0;
+
+#ifdef __SSE2__
+        __m128 vhold = _mm_set1_ps(holdTime), vdt = _mm_set1_ps(dt), vfall = _mm_set1_ps(fall);
+        __m128 vzero = _mm_setzero_ps();
+        for (; bin < res; bin += 4) {
+            __m128 e = _mm_load_ps(&in[bin]);
+
+            // new peaks reset the hold timer, held peaks count down, expired ones fall
+            __m128 p = _mm_load_ps(&pk[bin]);
+            __m128 h = _mm_load_ps(&hl[bin]);
+            __m128 fresh = _mm_cmpge_ps(e, p);
+            __m128 holding = _mm_cmpgt_ps(h, vzero);
+            __m128 fallen = _mm_max_ps(_mm_sub_ps(p, vfall), e);
+            p = _mm_or_ps(_mm_and_ps(fresh, e),
+                          _mm_andnot_ps(fresh, _mm_or_ps(_mm_and_ps(holding, p), _mm_andnot_ps(holding, fallen))));
+            h = _mm_or_ps(_mm_and_ps(fresh, vhold), _mm_andnot_ps(fresh, _mm_max_ps(_mm_sub_ps(h, vdt), vzero)));
+
+            _mm_store_ps(&pk[bin], p);
+            _mm_store_ps(&hl[bin], h);
+        }
+#endif
+
+        // whole pass without SSE:
+        for (; bin < res; bin++) {
+            float e = in[bin];
+            if (e >= pk[bin]) {
+                pk[bin] = e;
+                hl[bin] = holdTime;
+            } else if (hl[bin] > 0) {
+                hl[bin] = (hl[bin] - dt > 0) ? hl[bin] - dt : 0;
+            } else {
+                pk[bin] = (pk[bin] - fall > e) ? pk[bin] - fall : e;
+            }
+        }
+    }
+    return peak;
+}
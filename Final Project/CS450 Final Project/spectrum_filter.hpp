@@ -0,0 +1,26 @@
+//
+//  spectrum_filter.hpp
+//  CS450 Final Project
+//
+
+#ifndef spectrum_filter_hpp
+#define spectrum_filter_hpp
+
+#include <stdio.h>
+#include <cmath>
+#include <string.h>
+#include "analysis_arena.hpp"
+
+extern bool PeakHoldOn;     // follow the shown spectrum's peaks (for the sphere's peak rings)
+
+void InitSpectrumFilter(int channels, int res);
+
+// time constants in seconds (0 means follow the input immediately):
+void setSmoothing(float attack, float release);
+// seconds a peak is held before falling, and how fast it falls (units/second):
+void setPeakHold(float hold, float fall);
+
+void filterSpectrum(float **spec, int channels, int res, float dt);
+float** holdPeaks(float **spec, int channels, int res, float dt);
+
+#endif /* spectrum_filter_hpp */
@@ -33,7 +33,23 @@ void DrawPoint(struct point *p) {
     glVertex3f(p->x, p->y, p->z);
 }
 
-void MjbSphere(float rad, int slices, int stacks, float** spec) {
+// radius of the bulging sphere at grid point (ilat, ilng) (NumLats and NumLngs must be set):
+float bulgeRadius(float rad, int ilat, int ilng, float* upper, float* lower) {
+    float newLat = rerange(ilat, NumLats/2, NumLats, -M_PI, M_PI);
+    if (ilat > NumLats/2) {
+        if (!upper) return rad;
+        return rad + (cosf(newLat) + 1) * bounceMult * upper[ilng];
+    }
+    
+    if (!lower) return rad;
+    int newLng = ilng + NumLngs/2;
+    if (newLng >= NumLngs) newLng -= NumLngs;
+    return rad + (cosf(newLat) + 1) * bounceMult * lower[newLng];
+}
+
+// upper and lower are the spectra that bulge the top and bottom halves
+// (the lower one is drawn rotated half way round); either may be NULL
+void MjbSphere(float rad, int slices, int stacks, float* upper, float* lower) {
     struct point top, bot;		// top, bottom points
     struct point *p;
     
@@ -50,19 +66,7 @@ void MjbSphere(float rad, int slices, int stacks, float** spec) {
         float xz = cos(lat);
         float y = sin(lat);
         for (int ilng = 0; ilng < NumLngs; ilng++) {
-            if (!spec) {
-                radius = rad;
-            } else if (ilat > NumLats/2) {
-                float newLat = rerange(ilat, NumLats/2, NumLats, -M_PI, M_PI);
-                float bulge = spec[0][ilng];
-                radius = rad + (cosf(newLat) + 1) * bounceMult * bulge;
-            } else {
-                int newLng = ilng + NumLngs/2;
-                if (newLng >= NumLngs) newLng -= NumLngs;
-                float newLat = rerange(ilat, NumLats/2, NumLats, -M_PI, M_PI);
-                float bulge = spec[1][newLng];
-                radius = rad + (cosf(newLat) + 1) * bounceMult * bulge;
-            }
+            radius = bulgeRadius(rad, ilat, ilng, upper, lower);
             
             float lng = -M_PI  +  2. * M_PI * (float)ilng / (float)(NumLngs-1);
             float x =  xz * cos(lng);
@@ -134,6 +138,57 @@ void MjbSphere(float rad, int slices, int stacks, float** spec) {
     }
     glEnd();
     
+    // poles, then the bands in between
+    profileCount(COUNT_DRAW_CALLS, 3);
+    profileCount(COUNT_SPHERE_VERTICES, 4 * (NumLngs-1) * (NumLats-1));
+    
     delete [] Pts;
     Pts = NULL;
 }
+
+/**
+ ** radius MjbSphere(rad, slices, stacks, upper, lower) has at texture coordinates
+ ** (s, t), blended between the grid points around it (for drawing the same
+ ** sphere in pieces):
+ **/
+float MjbSphereRadius(float rad, int slices, int stacks, float* upper, float* lower, float s, float t) {
+    NumLngs = (slices > 3) ? slices : 3;
+    NumLats = (stacks > 3) ? stacks : 3;
+    
+    float fl = std::min(std::max(t, 0.f), 1.f) * (NumLats-1);
+    float fg = std::min(std::max(s, 0.f), 1.f) * (NumLngs-1);
+    int ilat = std::min((int)fl, NumLats-2);
+    int ilng = std::min((int)fg, NumLngs-2);
+    fl -= ilat;
+    fg -= ilng;
+    
+    float r0 = bulgeRadius(rad, ilat, ilng, upper, lower) * (1-fg) + bulgeRadius(rad, ilat, ilng+1, upper, lower) * fg;
+    float r1 = bulgeRadius(rad, ilat+1, ilng, upper, lower) * (1-fg) + bulgeRadius(rad, ilat+1, ilng+1, upper, lower) * fg;
+    return r0 * (1-fl) + r1 * fl;
+}
+
+/**
+ ** the crests of MjbSphere(rad, slices, stacks, upper, lower) as rings, one
+ ** around each half at the latitude where its bulge is tallest: given held
+ ** peaks, they mark the highest the surface has reached lately
+ **/
+void MjbSpherePeaks(float rad, int slices, int stacks, float* upper, float* lower) {
+    NumLngs = (slices > 3) ? slices : 3;
+    NumLats = (stacks > 3) ? stacks : 3;
+    
+    int crests[2] = { NumLats/4, 3*NumLats/4 };
+    for (int i = 0; i < 2; i++) {
+        int ilat = crests[i];
+        float lat = -M_PI/2.  +  M_PI * (float)ilat / (float)(NumLats-1);
+        float xz = cos(lat);
+        float y = sin(lat);
+        glBegin(GL_LINE_STRIP);
+        for (int ilng = 0; ilng < NumLngs; ilng++) {
+            float r = bulgeRadius(rad, ilat, ilng, upper, lower);
+            float lng = -M_PI  +  2. * M_PI * (float)ilng / (float)(NumLngs-1);
+            glVertex3f(r * xz * cos(lng), r * y, -r * xz * sin(lng));
+        }
+        glEnd();
+    }
+    profileCount(COUNT_DRAW_CALLS, 2);
+}
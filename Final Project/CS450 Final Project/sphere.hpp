@@ -23,11 +23,15 @@
 
 #include <stdio.h>
 #include <cmath>
+#include <algorithm>
 #include "utility_funcs.hpp"
 #include "glut_funcs.hpp"
+#include "profiler.hpp"
 
 extern int bounceMult;
 
-void MjbSphere(float rad, int slices, int stacks, float** spec);
+void MjbSphere(float rad, int slices, int stacks, float* upper, float* lower);
+float MjbSphereRadius(float rad, int slices, int stacks, float* upper, float* lower, float s, float t);
+void MjbSpherePeaks(float rad, int slices, int stacks, float* upper, float* lower);
 
 #endif /* sphere_hpp */
@@ -0,0 +1,308 @@
+//
+//  texture_atlas.cpp
+//  CS450 Final Project
+//
+//  Packs many small BMPs into one RGBA texture with a skyline packer, so a
+//  scene full of textured props binds one texture instead of one per prop.
+//  Geometry keeps its own 0..1 texture coordinates: either pass them through
+//  AtlasTexCoord(), or load the entry's transform into the texture matrix.
+//
+
+#include "texture_atlas.hpp"
+#include "glut_funcs.hpp"
+
+// an image waiting to be packed:
+typedef struct {
+    unsigned char *pixels;      // RGBA, bottom row first
+    int width, height;
+} AtlasImage;
+
+// one step of the skyline: the top of everything packed in [x, x+width)
+typedef struct {
+    int x, y, width;
+} SkylineNode;
+
+std::vector<AtlasEntry>     entries;
+std::vector<AtlasImage>     images;         // source images, parallel to entries
+GLuint                      atlasTex = 0;
+int                         atlasSize = 0;
+bool                        atlasCleanup = false;   // cleanAtlas registered
+
+void cleanAtlas() {
+    AtlasClear();
+}
+
+static int findEntry(const char *name) {
+    for (size_t i = 0; i < entries.size(); i++)
+        if (strcmp(entries[i].filename, name) == 0)
+            return (int)i;
+    return -1;
+}
+
+/**
+ ** queue a BMP for the atlas and return its entry number (-1 if it cannot be read);
+ ** it is placed by the next AtlasBuild()
+ **/
+int AtlasAdd(char *filename) {
+    int found = findEntry(filename);
+    if (found >= 0) return found;
+
+    int width, height, ncomps;
+    unsigned char *pixels = BmpToImage(filename, &width, &height, &ncomps);
+    if (pixels == NULL)
+        return -1;
+    return AtlasAddImage(filename, pixels, width, height, ncomps);
+}
+
+/**
+ ** queue an RGB or RGBA image (bottom row first, allocated with new[]; the atlas
+ ** takes it over) under name; -1, with the image freed, if it could never fit
+ **/
+int AtlasAddImage(const char *name, unsigned char *pixels, int width, int height, int ncomps) {
+    int found = findEntry(name);
+    if (found >= 0) {
+        delete [] pixels;
+        return found;
+    }
+
+    // anything bigger than the largest atlas (less its padding) is turned away
+    // before its size is worked out
+    int largest = ATLAS_MAX_SIZE - 2*ATLAS_PADDING;
+    if (width < 1 || height < 1 || width > largest || height > largest || (ncomps != 3 && ncomps != 4)) {
+        fprintf(stderr, "Atlas: '%s' (%d x %d) does not fit in any atlas\n", name, width, height);
+        delete [] pixels;
+        return -1;
+    }
+
+    // everything is RGBA in the atlas
+    if (ncomps == 3) {
+        size_t texels = (size_t)width * height;
+        unsigned char *rgba = new unsigned char[4 * texels];
+        for (size_t i = 0; i < texels; i++) {
+            memcpy(&rgba[4*i], &pixels[3*i], 3);
+            rgba[4*i + 3] = 255;
+        }
+        delete [] pixels;
+        pixels = rgba;
+    }
+
+    if (!atlasCleanup) {
+        atexit(cleanAtlas);
+        atlasCleanup = true;
+    }
+
+    AtlasEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    strncpy(entry.filename, name, sizeof(entry.filename) - 1);
+    entry.width = width;
+    entry.height = height;
+    entries.push_back(entry);
+
+    AtlasImage image = { pixels, width, height };
+    images.push_back(image);
+    return (int)entries.size() - 1;
+}
+
+// lowest y a w x h box can sit at on the skyline starting at node i (-1 if it does not fit):
+int skylineFit(std::vector<SkylineNode> &skyline, size_t i, int w, int h, int size) {
+    int x = skyline[i].x;
+    if (x + w > size) return -1;
+
+    int y = skyline[i].y;
+    int left = w;
+    for (size_t j = i; left > 0; j++) {
+        if (j >= skyline.size()) return -1;
+        y = std::max(y, skyline[j].y);
+        if (y + h > size) return -1;
+        left -= skyline[j].width;
+    }
+    return y;
+}
+
+// raise the skyline over a box placed at node i:
+void skylineAdd(std::vector<SkylineNode> &skyline, size_t i, int w, int h, int y) {
+    SkylineNode node = { skyline[i].x, y + h, w };
+    skyline.insert(skyline.begin() + i, node);
+
+    // trim or drop the nodes now underneath it
+    for (size_t j = i + 1; j < skyline.size(); ) {
+        int shadow = skyline[j-1].x + skyline[j-1].width - skyline[j].x;
+        if (shadow <= 0) break;
+        skyline[j].x += shadow;
+        skyline[j].width -= shadow;
+        if (skyline[j].width > 0) break;
+        skyline.erase(skyline.begin() + j);
+    }
+
+    // merge runs at the same height
+    for (size_t j = 0; j + 1 < skyline.size(); ) {
+        if (skyline[j].y == skyline[j+1].y) {
+            skyline[j].width += skyline[j+1].width;
+            skyline.erase(skyline.begin() + j + 1);
+        } else {
+            j++;
+        }
+    }
+}
+
+/**
+ ** place every entry in a size x size square, tallest first, each at the lowest
+ ** (then leftmost) spot on the skyline; false if they do not all fit
+ **/
+bool packAtlas(int size, std::vector<int> &order) {
+    std::vector<SkylineNode> skyline;
+    SkylineNode floor = { 0, 0, size };
+    skyline.push_back(floor);
+
+    for (size_t k = 0; k < order.size(); k++) {
+        AtlasEntry *e = &entries[order[k]];
+        int w = e->width + 2*ATLAS_PADDING;
+        int h = e->height + 2*ATLAS_PADDING;
+
+        int bestY = -1, bestX = 0;
+        size_t best = 0;
+        for (size_t i = 0; i < skyline.size(); i++) {
+            int y = skylineFit(skyline, i, w, h, size);
+            if (y < 0) continue;
+            if (bestY < 0 || y < bestY || (y == bestY && skyline[i].x < bestX)) {
+                bestY = y;
+                bestX = skyline[i].x;
+                best = i;
+            }
+        }
+        if (bestY < 0) return false;
+
+        e->x = bestX + ATLAS_PADDING;
+        e->y = bestY + ATLAS_PADDING;
+        skylineAdd(skyline, best, w, h, bestY);
+    }
+    return true;
+}
+
+// copy an image into the atlas, repeating its edge texels out into the padding:
+void blitPadded(unsigned char *atlas, int size, AtlasEntry *e, AtlasImage *image) {
+    for (int t = -ATLAS_PADDING; t < e->height + ATLAS_PADDING; t++) {
+        int st = std::min(std::max(t, 0), e->height - 1);
+        unsigned char *src = image->pixels + 4 * (size_t)st * image->width;
+        unsigned char *dst = atlas + 4 * ((size_t)(e->y + t) * size + e->x);
+
+        memcpy(dst, src, 4 * e->width);
+        for (int p = 1; p <= ATLAS_PADDING; p++) {
+            memcpy(dst - 4*p, src, 4);
+            memcpy(dst + 4*(e->width - 1 + p), src + 4*(e->width - 1), 4);
+        }
+    }
+}
+
+/**
+ ** place everything added so far in the smallest power of two square up to
+ ** maxSize that holds it all, and compose it: returns the RGBA texels (the
+ ** caller deletes them) and sets *size, or NULL if it does not all fit.
+ ** Needs no GL, so the packing can be run and checked anywhere
+ **/
+unsigned char* AtlasPack(int maxSize, int *packedSize) {
+    if (entries.empty()) return NULL;
+
+    // tallest first keeps the skyline flat
+    std::vector<int> order;
+    for (size_t i = 0; i < entries.size(); i++)
+        order.push_back((int)i);
+    std::sort(order.begin(), order.end(), [](int a, int b) {
+        if (entries[a].height != entries[b].height) return entries[a].height > entries[b].height;
+        return entries[a].width > entries[b].width;
+    });
+
+    int size = ATLAS_MIN_SIZE;
+    while (size <= maxSize && !packAtlas(size, order))
+        size *= 2;
+    if (size > maxSize) {
+        fprintf(stderr, "Atlas: %d images do not fit in %d x %d\n", (int)entries.size(), maxSize, maxSize);
+        return NULL;
+    }
+
+    unsigned char *atlas = new unsigned char[4 * (size_t)size * size];
+    memset(atlas, 0, 4 * (size_t)size * size);
+    for (size_t i = 0; i < entries.size(); i++) {
+        AtlasEntry *e = &entries[i];
+        blitPadded(atlas, size, e, &images[i]);
+        e->uOffset = (float)e->x / size;
+        e->vOffset = (float)e->y / size;
+        e->uScale = (float)e->width / size;
+        e->vScale = (float)e->height / size;
+    }
+    *packedSize = size;
+    return atlas;
+}
+
+/**
+ ** pack everything added so far into one texture and upload it; the source
+ ** images are kept so adding more and building again repacks the lot
+ **/
+bool AtlasBuild(int maxSize) {
+    int size;
+    unsigned char *atlas = AtlasPack(maxSize, &size);
+    if (atlas == NULL) return false;
+
+    if (atlasTex == 0) glGenTextures(1, &atlasTex);
+    glBindTexture(GL_TEXTURE_2D, atlasTex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, atlas);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    atlasSize = size;
+    delete [] atlas;
+
+    if (DebugOn)
+        fprintf(stderr, "Atlas: %d images in %d x %d\n", (int)entries.size(), size, size);
+    return true;
+}
+
+void AtlasClear() {
+    for (size_t i = 0; i < images.size(); i++)
+        delete [] images[i].pixels;
+    images.clear();
+    entries.clear();
+    if (atlasTex != 0) {
+        glDeleteTextures(1, &atlasTex);
+        atlasTex = 0;
+    }
+    atlasSize = 0;
+}
+
+void BindAtlas() {
+    glBindTexture(GL_TEXTURE_2D, atlasTex);
+}
+
+// where (s, t) in the entry's own 0..1 space is in the atlas:
+void AtlasUV(int entry, float s, float t, float *u, float *v) {
+    AtlasEntry *e = &entries[entry];
+    *u = e->uOffset + s * e->uScale;
+    *v = e->vOffset + t * e->vScale;
+}
+
+// glTexCoord2f for (s, t) in the entry's own 0..1 space:
+void AtlasTexCoord(int entry, float s, float t) {
+    float u, v;
+    AtlasUV(entry, s, t, &u, &v);
+    glTexCoord2f(u, v);
+}
+
+// map the entry's own 0..1 texture coordinates into the atlas through the texture matrix:
+void AtlasTexTransform(int entry) {
+    AtlasEntry *e = &entries[entry];
+    GLint mode;
+    glGetIntegerv(GL_MATRIX_MODE, &mode);
+    glMatrixMode(GL_TEXTURE);
+    glLoadIdentity();
+    glTranslatef(e->uOffset, e->vOffset, 0.);
+    glScalef(e->uScale, e->vScale, 1.);
+    glMatrixMode(mode);
+}
+
+AtlasEntry* AtlasGetEntry(int entry) {
+    if (entry < 0 || entry >= (int)entries.size()) return NULL;
+    return &entries[entry];
+}
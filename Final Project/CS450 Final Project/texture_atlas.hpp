@@ -0,0 +1,54 @@
+//
+//  texture_atlas.hpp
+//  CS450 Final Project
+//
+
+#ifndef texture_atlas_hpp
+#define texture_atlas_hpp
+
+#ifdef WIN32
+#include <windows.h>
+#pragma warning(disable:4996)
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <GL/glu.h>
+#include <GL/glut.h>
+#else
+#include <GLUT/glut.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include "BmpToTexture.hpp"
+
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+
+// texels of repeated edge around each entry, so linear filtering never bleeds:
+#define ATLAS_PADDING       2
+// smallest and largest atlas tried (square, powers of two):
+#define ATLAS_MIN_SIZE      256
+#define ATLAS_MAX_SIZE      4096
+
+// where one image ended up: u = uOffset + s * uScale (and the same for v, t)
+typedef struct {
+    char filename[256];
+    int x, y, width, height;    // texels, padding excluded
+    float uOffset, vOffset;
+    float uScale, vScale;
+} AtlasEntry;
+
+int AtlasAdd(char *filename);
+int AtlasAddImage(const char *name, unsigned char *pixels, int width, int height, int ncomps);
+unsigned char* AtlasPack(int maxSize, int *packedSize);
+bool AtlasBuild(int maxSize);
+void AtlasClear();
+
+void BindAtlas();
+void AtlasUV(int entry, float s, float t, float *u, float *v);
+void AtlasTexCoord(int entry, float s, float t);
+void AtlasTexTransform(int entry);
+AtlasEntry* AtlasGetEntry(int entry);
+
+#endif /* texture_atlas_hpp */
@@ -0,0 +1,313 @@
+//
+//  texture_cache.cpp
+//  CS450 Final Project
+//
+//  The first run encodes each texture (and its mip chain) to BC1 and saves it
+//  next to the source as <file>.bc1; later runs upload those blocks as they
+//  are, a sixth of the size of the RGB they replace on disk and in VRAM.
+//  A cache file is used while its source keeps the same size and either the
+//  same mtime or, failing that, the same contents hash.
+//
+
+#include "texture_cache.hpp"
+
+// cache file layout: this header, then each level's blocks in order
+typedef struct {
+    char magic[4];              // "BC1C"
+    int version;
+    long long sourceSize;
+    long long sourceMtime;
+    unsigned long long sourceHash;
+    int flags;                  // CACHE_* the chain was built with
+    int numLevels;
+    int dims[MIP_MAX_LEVELS][2];
+} CacheHeader;
+
+#define CACHE_MIPMAPS   1
+#define CACHE_SRGB      2
+
+
+
+
+size_t Bc1Size(int width, int height) {
+    return 8 * (size_t)((width + 3) / 4) * (size_t)((height + 3) / 4);
+}
+
+// 8 bit RGB to 5:6:5, and back with the top bits repeated:
+unsigned short pack565(int r, int g, int b) {
+    return (unsigned short)(((r * 31 + 127) / 255) << 11 | ((g * 63 + 127) / 255) << 5 | ((b * 31 + 127) / 255));
+}
+
+void unpack565(unsigned short c, int rgb[3]) {
+    int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+/**
+ ** encode one 4x4 block of texels (row major, 3 bytes each) into 8 bytes:
+ ** endpoints span the block's bounding box, turned to follow the colour
+ ** trend, and each texel takes the nearest of the 4 palette entries along it
+ **/
+void encodeBlock(unsigned char texels[16][3], unsigned char *out) {
+    int lo[3] = { 255, 255, 255 }, hi[3] = { 0, 0, 0 }, mean[3] = { 0, 0, 0 };
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 3; c++) {
+            if (texels[i][c] < lo[c]) lo[c] = texels[i][c];
+            if (texels[i][c] > hi[c]) hi[c] = texels[i][c];
+            mean[c] += texels[i][c];
+        }
+    }
+
+    // red and blue run against green across the block: swap their ends of the box
+    int covRG = 0, covBG = 0;
+    for (int i = 0; i < 16; i++) {
+        int dg = 16 * texels[i][1] - mean[1];
+        covRG += (16 * texels[i][0] - mean[0]) * dg;
+        covBG += (16 * texels[i][2] - mean[2]) * dg;
+    }
+    if (covRG < 0) { int t = lo[0]; lo[0] = hi[0]; hi[0] = t; }
+    if (covBG < 0) { int t = lo[2]; lo[2] = hi[2]; hi[2] = t; }
+
+    // pull the ends in a little, so the palette covers the texels rather than the extremes
+    for (int c = 0; c < 3; c++) {
+        int inset = (hi[c] - lo[c]) / 16;
+        hi[c] -= inset;
+        lo[c] += inset;
+    }
+
+    unsigned short c0 = pack565(hi[0], hi[1], hi[2]);
+    unsigned short c1 = pack565(lo[0], lo[1], lo[2]);
+    unsigned int indices = 0;
+
+    if (c0 != c1) {
+        // c0 > c1 selects the 4 colour mode
+        if (c0 < c1) { unsigned short t = c0; c0 = c1; c1 = t; }
+        int p0[3], p1[3];
+        unpack565(c0, p0);
+        unpack565(c1, p1);
+
+        int axis[3] = { p0[0] - p1[0], p0[1] - p1[1], p0[2] - p1[2] };
+        int len = axis[0]*axis[0] + axis[1]*axis[1] + axis[2]*axis[2];
+
+        // position along p1 -> p0 in thirds: 0 = p1, 1 = 2/3 p1, 2 = 2/3 p0, 3 = p0
+        static const int slot[4] = { 1, 3, 2, 0 };
+        for (int i = 0; i < 16; i++) {
+            int d = (texels[i][0] - p1[0]) * axis[0] + (texels[i][1] - p1[1]) * axis[1] + (texels[i][2] - p1[2]) * axis[2];
+            int step = (d <= 0) ? 0 : (d >= len) ? 3 : (3 * d + len / 2) / len;
+            indices |= (unsigned int)slot[step] << (2 * i);
+        }
+    }
+
+    out[0] = c0 & 0xff;  out[1] = c0 >> 8;
+    out[2] = c1 & 0xff;  out[3] = c1 >> 8;
+    out[4] = indices & 0xff;  out[5] = (indices >> 8) & 0xff;
+    out[6] = (indices >> 16) & 0xff;  out[7] = indices >> 24;
+}
+
+/**
+ ** encode tightly packed RGB rows into BC1 blocks, in the same row order
+ ** (edge blocks repeat the last row and column):
+ **/
+void EncodeBc1(unsigned char *rgb, int width, int height, unsigned char *blocks) {
+    unsigned char texels[16][3];
+    for (int by = 0; by < height; by += 4) {
+        for (int bx = 0; bx < width; bx += 4) {
+            for (int y = 0; y < 4; y++) {
+                int t = std::min(by + y, height - 1);
+                for (int x = 0; x < 4; x++) {
+                    int s = std::min(bx + x, width - 1);
+                    memcpy(texels[4*y + x], rgb + 3 * ((size_t)t * width + s), 3);
+                }
+            }
+            encodeBlock(texels, blocks);
+            blocks += 8;
+        }
+    }
+}
+
+// encode every level of an RGB chain:
+void CompressMipChain(MipChain *chain, Bc1Chain *bc1) {
+    memset(bc1, 0, sizeof(Bc1Chain));
+    bc1->numLevels = chain->numLevels;
+    for (int i = 0; i < chain->numLevels; i++) {
+        MipLevel *level = &chain->levels[i];
+        Bc1Level *out = &bc1->levels[i];
+        out->width = level->width;
+        out->height = level->height;
+        out->size = Bc1Size(level->width, level->height);
+        out->blocks = new unsigned char[out->size];
+        EncodeBc1(level->pixels, level->width, level->height, out->blocks);
+    }
+}
+
+void FreeBc1Chain(Bc1Chain *bc1) {
+    for (int i = 0; i < bc1->numLevels; i++)
+        delete [] bc1->levels[i].blocks;
+    bc1->numLevels = 0;
+}
+
+// FNV-1a over the whole source file:
+bool hashFile(char *filename, unsigned long long *hash) {
+    FILE *fp = fopen(filename, "rb");
+    if (fp == NULL) return false;
+
+    unsigned long long h = 14695981039346656037ULL;
+    unsigned char buf[64 * 1024];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+        for (size_t i = 0; i < n; i++)
+            h = (h ^ buf[i]) * 1099511628211ULL;
+    fclose(fp);
+
+    *hash = h;
+    return true;
+}
+
+void cacheName(char *filename, char *name, size_t length) {
+    snprintf(name, length, "%s%s", filename, TEXTURE_CACHE_SUFFIX);
+}
+
+/**
+ ** write a cache file (through a temporary, so a half-written cache is never
+ ** picked up); false, quietly, if it cannot be written
+ **/
+static bool writeCache(char *name, CacheHeader *header, Bc1Chain *bc1) {
+    char temp[520];
+    snprintf(temp, sizeof(temp), "%s.tmp", name);
+    FILE *fp = fopen(temp, "wb");
+    if (fp == NULL)
+        return false;
+
+    bool ok = fwrite(header, sizeof(CacheHeader), 1, fp) == 1;
+    for (int i = 0; ok && i < bc1->numLevels; i++)
+        ok = fwrite(bc1->levels[i].blocks, bc1->levels[i].size, 1, fp) == 1;
+    ok = (fclose(fp) == 0) && ok;
+
+#ifdef WIN32
+    if (ok) remove(name);
+#endif
+    if (!ok || rename(temp, name) != 0) {
+        remove(temp);
+        return false;
+    }
+    return true;
+}
+
+/**
+ ** true if the header's levels make a mip chain of sane dimensions (each half
+ ** the last) that is exactly as long as the cache file; checked before any
+ ** of it is allocated
+ **/
+static bool validLevels(CacheHeader *header, bool mipmaps, size_t fileLength) {
+    if (!mipmaps && header->numLevels != 1) return false;
+
+    size_t total = sizeof(CacheHeader);
+    for (int i = 0; i < header->numLevels; i++) {
+        int width = header->dims[i][0], height = header->dims[i][1];
+        if (width < 1 || width > BMP_MAX_DIMENSION || height < 1 || height > BMP_MAX_DIMENSION)
+            return false;
+        if (i == 0 && (size_t)width * height > BMP_MAX_PIXELS)
+            return false;
+        if (i > 0 && (width != std::max(header->dims[i-1][0] / 2, 1) || height != std::max(header->dims[i-1][1] / 2, 1)))
+            return false;
+        total += Bc1Size(width, height);
+    }
+    return total == fileLength;
+}
+
+/**
+ ** load the cached blocks for filename, if the cache is still good for it
+ ** (the cache is only read here, so a read-only install still gets hits):
+ **/
+bool LoadTextureCache(char *filename, bool mipmaps, bool srgb, Bc1Chain *bc1) {
+    memset(bc1, 0, sizeof(Bc1Chain));
+
+    struct stat source, cache;
+    if (stat(filename, &source) != 0)
+        return false;
+
+    char name[512];
+    cacheName(filename, name, sizeof(name));
+    if (stat(name, &cache) != 0)
+        return false;
+    FILE *fp = fopen(name, "rb");
+    if (fp == NULL)
+        return false;
+
+    CacheHeader header;
+    int flags = (mipmaps ? CACHE_MIPMAPS : 0) | (srgb ? CACHE_SRGB : 0);
+    if (fread(&header, sizeof(header), 1, fp) != 1 || memcmp(header.magic, "BC1C", 4) != 0 ||
+        header.version != TEXTURE_CACHE_VERSION || header.flags != flags ||
+        header.numLevels < 1 || header.numLevels > MIP_MAX_LEVELS ||
+        header.sourceSize != (long long)source.st_size) {
+        fclose(fp);
+        return false;
+    }
+
+    if (!validLevels(&header, mipmaps, (size_t)cache.st_size)) {
+        fprintf(stderr, "Texture cache '%s' is truncated or corrupt\n", name);
+        fclose(fp);
+        return false;
+    }
+
+    // touched but maybe not changed (a fresh checkout, say): check the contents
+    bool refresh = (header.sourceMtime != (long long)source.st_mtime);
+    if (refresh) {
+        unsigned long long hash;
+        if (!hashFile(filename, &hash) || hash != header.sourceHash) {
+            fclose(fp);
+            return false;
+        }
+        header.sourceMtime = (long long)source.st_mtime;
+    }
+
+    bc1->numLevels = header.numLevels;
+    for (int i = 0; i < header.numLevels; i++) {
+        Bc1Level *level = &bc1->levels[i];
+        level->width = header.dims[i][0];
+        level->height = header.dims[i][1];
+        level->size = Bc1Size(level->width, level->height);
+        level->blocks = new unsigned char[level->size];
+        if (fread(level->blocks, level->size, 1, fp) != 1) {
+            fprintf(stderr, "Texture cache '%s' is truncated\n", name);
+            FreeBc1Chain(bc1);
+            fclose(fp);
+            return false;
+        }
+    }
+    fclose(fp);
+
+    // save the new mtime so the next run skips the hash (if the cache can be written)
+    if (refresh) writeCache(name, &header, bc1);
+    return true;
+}
+
+// write the blocks for filename out to its cache file:
+bool SaveTextureCache(char *filename, bool mipmaps, bool srgb, Bc1Chain *bc1) {
+    struct stat source;
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    if (stat(filename, &source) != 0 || !hashFile(filename, &header.sourceHash))
+        return false;
+
+    memcpy(header.magic, "BC1C", 4);
+    header.version = TEXTURE_CACHE_VERSION;
+    header.sourceSize = (long long)source.st_size;
+    header.sourceMtime = (long long)source.st_mtime;
+    header.flags = (mipmaps ? CACHE_MIPMAPS : 0) | (srgb ? CACHE_SRGB : 0);
+    header.numLevels = bc1->numLevels;
+    for (int i = 0; i < bc1->numLevels; i++) {
+        header.dims[i][0] = bc1->levels[i].width;
+        header.dims[i][1] = bc1->levels[i].height;
+    }
+
+    char name[512];
+    cacheName(filename, name, sizeof(name));
+    if (!writeCache(name, &header, bc1)) {
+        fprintf(stderr, "Cannot write texture cache '%s'\n", name);
+        return false;
+    }
+    return true;
+}
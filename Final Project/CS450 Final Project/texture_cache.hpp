@@ -0,0 +1,58 @@
+//
+//  texture_cache.hpp
+//  CS450 Final Project
+//
+
+#ifndef texture_cache_hpp
+#define texture_cache_hpp
+
+#ifdef WIN32
+#include <windows.h>
+#pragma warning(disable:4996)
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <GL/glu.h>
+#include <GL/glut.h>
+#else
+#include <GLUT/glut.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "mipmap.hpp"
+#include "BmpToTexture.hpp"
+
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT     0x83F0
+#endif
+
+// appended to a texture's file name to name its cache file:
+#define TEXTURE_CACHE_SUFFIX    ".bc1"
+// (2: sRGB mips of white blocks were wrong in version 1 caches)
+#define TEXTURE_CACHE_VERSION   2
+
+// one BC1 (DXT1) level: 8 bytes per 4x4 block of texels
+typedef struct {
+    unsigned char *blocks;
+    int width, height;          // in texels
+    size_t size;                // bytes of blocks
+} Bc1Level;
+
+typedef struct {
+    int numLevels;
+    Bc1Level levels[MIP_MAX_LEVELS];
+} Bc1Chain;
+
+size_t Bc1Size(int width, int height);
+void EncodeBc1(unsigned char *rgb, int width, int height, unsigned char *blocks);
+void CompressMipChain(MipChain *chain, Bc1Chain *bc1);
+void FreeBc1Chain(Bc1Chain *bc1);
+
+bool LoadTextureCache(char *filename, bool mipmaps, bool srgb, Bc1Chain *bc1);
+bool SaveTextureCache(char *filename, bool mipmaps, bool srgb, Bc1Chain *bc1);
+
+#endif /* texture_cache_hpp */
@@ -0,0 +1,318 @@
+//
+//  texture_loader.cpp
+//  CS450 Final Project
+//
+//  Worker threads map BMPs and fault their pages in (or decode them and build
+//  their mip chains, for formats GL cannot read directly or when mipmaps are
+//  wanted); the GL thread uploads the rows a few at a time through a pixel
+//  buffer object, so no single frame pays for a whole texture (or any disk
+//  reads). Until a texture is complete it is drawn with a placeholder.
+//  Compressed textures come from the BC1 cache, which a worker fills the
+//  first time round.
+//
+
+#include "texture_loader.hpp"
+
+typedef struct {
+    char filename[256];
+    GLuint tex;                 // texture name the image ends up in
+    int flags;                  // TEXTURE_* options
+    BmpMapping map;             // the mapped file (set by a worker)
+    bool mapped;                // map is valid
+    MipChain chain;             // decoded levels, when the mapped rows are not usable
+    Bc1Chain bc1;               // compressed levels, for TEXTURE_COMPRESSED
+    bool decoded;               // worker finished (none may be set on failure)
+    bool ready;                 // every row of every level is in the texture
+    int level;                  // level being uploaded
+    int rowsUploaded;           // rows of that level already in the texture
+    int bytes;                  // texture memory the finished levels take up
+    GLuint pbo;                 // staging buffer for the upload
+} TextureJob;
+
+std::vector<TextureJob*>    jobs;           // every job, in request order
+std::deque<TextureJob*>     decodeQueue;    // jobs waiting for a worker
+std::vector<std::thread>    workers;
+std::mutex                  jobLock;        // guards decodeQueue and the decoded/map/chain/bc1 fields
+std::condition_variable     jobWaiting;
+bool                        stopWorkers = false;
+GLuint                      placeholder;
+bool                        s3tc = false;   // BC1 uploads work (else TEXTURE_COMPRESSED is ignored)
+
+void decodeWorker() {
+    traceThreadName("Texture decode");
+    for (;;) {
+        TextureJob *job;
+        {
+            std::unique_lock<std::mutex> lock(jobLock);
+            while (!stopWorkers && decodeQueue.empty())
+                jobWaiting.wait(lock);
+            if (stopWorkers) return;
+            job = decodeQueue.front();
+            decodeQueue.pop_front();
+        }
+        TRACE_ZONE("Decode texture");
+
+        bool mipmaps = (job->flags & TEXTURE_MIPMAPS) != 0;
+        bool srgb = (job->flags & TEXTURE_SRGB) != 0;
+        bool compress = (job->flags & TEXTURE_COMPRESSED) != 0;
+
+        // a good cache file means the BMP is never touched
+        Bc1Chain bc1;
+        if (compress && LoadTextureCache(job->filename, mipmaps, srgb, &bc1)) {
+            std::lock_guard<std::mutex> lock(jobLock);
+            job->bc1 = bc1;
+            job->decoded = true;
+            continue;
+        }
+
+        BmpMapping map;
+        bool mapped = BmpMap(job->filename, &map);
+        bool decode = mapped && (map.format == 0 || mipmaps || compress);
+
+        // touch every page so the GL thread never waits on the disk
+        if (mapped && !decode) {
+            volatile unsigned char sink = 0;
+            size_t size = (size_t)map.rowbytes * map.height;
+            for (size_t b = 0; b < size; b += 4096)
+                sink ^= map.pixels[b];
+        }
+
+        // paletted, bitfield and top-down images, and anything that wants
+        // mipmaps or compressing, are converted (and filtered) here instead
+        MipChain chain;
+        memset(&chain, 0, sizeof(MipChain));
+        if (decode) {
+            BmpUnmap(&map);
+            mapped = false;
+
+            int width, height, ncomps;
+            unsigned char *pixels = BmpToImage(job->filename, &width, &height, &ncomps);
+            if (pixels != NULL && mipmaps) {
+                BuildMipChain(pixels, width, height, ncomps, srgb, &chain);
+            } else if (pixels != NULL) {
+                chain.ncomps = ncomps;
+                chain.numLevels = 1;
+                chain.levels[0].pixels = pixels;
+                chain.levels[0].width = width;
+                chain.levels[0].height = height;
+            }
+        }
+
+        // BC1 has no alpha to speak of, so RGBA images stay uncompressed
+        memset(&bc1, 0, sizeof(Bc1Chain));
+        if (compress && chain.numLevels > 0 && chain.ncomps == 3) {
+            CompressMipChain(&chain, &bc1);
+            FreeMipChain(&chain);
+            SaveTextureCache(job->filename, mipmaps, srgb, &bc1);
+        }
+
+        std::lock_guard<std::mutex> lock(jobLock);
+        job->map = map;
+        job->mapped = mapped;
+        job->chain = chain;
+        job->bc1 = bc1;
+        job->decoded = true;
+    }
+}
+
+void cleanTextureLoader() {
+    puts("Cleaning texture loader resources");
+
+    {
+        std::lock_guard<std::mutex> lock(jobLock);
+        stopWorkers = true;
+    }
+    jobWaiting.notify_all();
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i].join();
+
+    for (size_t i = 0; i < jobs.size(); i++) {
+        if (jobs[i]->mapped) BmpUnmap(&jobs[i]->map);
+        FreeMipChain(&jobs[i]->chain);
+        FreeBc1Chain(&jobs[i]->bc1);
+        delete jobs[i];
+    }
+}
+
+// start the decode workers and make the placeholder (call with the GL context current):
+void InitTextureLoader(int numWorkers) {
+    // a flat mid grey until the real texture arrives
+    unsigned char grey[3] = { 128, 128, 128 };
+    glGenTextures(1, &placeholder);
+    glBindTexture(GL_TEXTURE_2D, placeholder);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, grey);
+
+    const char *ext = (const char*)glGetString(GL_EXTENSIONS);
+    s3tc = ext && strstr(ext, "GL_EXT_texture_compression_s3tc");
+    if (!s3tc)
+        fprintf(stderr, "No S3TC texture compression, uploading textures uncompressed\n");
+
+    if (numWorkers < 1) numWorkers = 1;
+    for (int i = 0; i < numWorkers; i++)
+        workers.push_back(std::thread(decodeWorker));
+
+    atexit(cleanTextureLoader);
+}
+
+// queue a BMP to be read in the background and uploaded into tex:
+void LoadTextureAsync(char *filename, GLuint tex, int flags) {
+    TextureJob *job = new TextureJob;
+    memset(job, 0, sizeof(TextureJob));
+    strncpy(job->filename, filename, sizeof(job->filename) - 1);
+    job->tex = tex;
+    job->flags = s3tc ? flags : (flags & ~TEXTURE_COMPRESSED);
+    jobs.push_back(job);
+
+    {
+        std::lock_guard<std::mutex> lock(jobLock);
+        decodeQueue.push_back(job);
+    }
+    jobWaiting.notify_one();
+}
+
+// rows of one level of a job, straight from the mapped file or from the decoded
+// or compressed chain (a compressed row is a row of 4x4 blocks):
+void jobLevel(TextureJob *job, int level, unsigned char **src, int *width, int *height, int *rowbytes, int *numRows) {
+    if (job->mapped) {
+        *src = job->map.pixels;
+        *width = job->map.width;
+        *height = job->map.height;
+        *rowbytes = job->map.rowbytes;
+        *numRows = *height;
+    } else if (job->bc1.numLevels > 0) {
+        Bc1Level *l = &job->bc1.levels[level];
+        *src = l->blocks;
+        *width = l->width;
+        *height = l->height;
+        *rowbytes = (int)Bc1Size(l->width, 1);
+        *numRows = (l->height + 3) / 4;
+    } else {
+        MipLevel *l = &job->chain.levels[level];
+        *src = l->pixels;
+        *width = l->width;
+        *height = l->height;
+        *rowbytes = job->chain.ncomps * l->width;
+        *numRows = *height;
+    }
+}
+
+// push up to maxBytes of decoded rows into their textures (GL thread, once per frame):
+void PumpTextureUploads(int maxBytes) {
+    for (size_t i = 0; i < jobs.size() && maxBytes > 0; i++) {
+        TextureJob *job = jobs[i];
+        if (job->ready) continue;
+
+        {
+            std::lock_guard<std::mutex> lock(jobLock);
+            if (!job->decoded) continue;
+        }
+        if (!job->mapped && job->chain.numLevels == 0 && job->bc1.numLevels == 0) {
+            // could not read it: leave the placeholder in place for good
+            job->ready = true;
+            continue;
+        }
+
+        bool compressed = (job->bc1.numLevels > 0);
+        int numLevels = job->mapped ? 1 : compressed ? job->bc1.numLevels : job->chain.numLevels;
+        int ncomps = job->mapped ? job->map.ncomps : job->chain.ncomps;
+        GLint internal = (ncomps == 4) ? GL_RGBA : GL_RGB;
+        GLenum format = job->mapped ? job->map.format : internal;
+
+        while (maxBytes > 0 && job->level < numLevels) {
+            unsigned char *src;
+            int width, height, rowbytes, numRows;
+            jobLevel(job, job->level, &src, &width, &height, &rowbytes, &numRows);
+
+            // first slice of a level: size it, and (re)size the staging buffer
+            if (job->rowsUploaded == 0) {
+                glBindTexture(GL_TEXTURE_2D, job->tex);
+                if (compressed)
+                    glCompressedTexImage2D(GL_TEXTURE_2D, job->level, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, width, height, 0, rowbytes * numRows, NULL);
+                else
+                    glTexImage2D(GL_TEXTURE_2D, job->level, internal, width, height, 0, format, GL_UNSIGNED_BYTE, NULL);
+
+                if (job->pbo == 0) glGenBuffers(1, &job->pbo);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, job->pbo);
+                glBufferData(GL_PIXEL_UNPACK_BUFFER, rowbytes * numRows, NULL, GL_STREAM_DRAW);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            }
+
+            int rows = maxBytes / rowbytes;
+            if (rows < 1) rows = 1;
+            if (rows > numRows - job->rowsUploaded) rows = numRows - job->rowsUploaded;
+
+            // stage the slice, then let the driver pull it from the buffer
+            // (BMP rows keep their padding, which the 4 byte unpack alignment skips)
+            size_t offset = (size_t)rowbytes * job->rowsUploaded;
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, job->pbo);
+            glBufferSubData(GL_PIXEL_UNPACK_BUFFER, offset, rowbytes * rows, src + offset);
+            glBindTexture(GL_TEXTURE_2D, job->tex);
+            if (compressed) {
+                int y = 4 * job->rowsUploaded;
+                int h = std::min(4 * rows, height - y);
+                glCompressedTexSubImage2D(GL_TEXTURE_2D, job->level, 0, y, width, h, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, rowbytes * rows, (GLvoid*)offset);
+            } else {
+                glPixelStorei(GL_UNPACK_ALIGNMENT, (rowbytes % 4 == 0) ? 4 : 1);
+                glTexSubImage2D(GL_TEXTURE_2D, job->level, 0, job->rowsUploaded, width, rows, format, GL_UNSIGNED_BYTE, (GLvoid*)offset);
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            }
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+            job->rowsUploaded += rows;
+            maxBytes -= rowbytes * rows;
+            if (job->rowsUploaded == numRows) {
+                job->bytes += compressed ? rowbytes * numRows : ncomps * width * height;
+                job->level++;
+                job->rowsUploaded = 0;
+            }
+        }
+
+        // done: the source rows and staging buffer are no longer needed
+        if (job->level == numLevels) {
+            glBindTexture(GL_TEXTURE_2D, job->tex);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, numLevels - 1);
+            glDeleteBuffers(1, &job->pbo);
+            job->pbo = 0;
+            if (job->mapped) BmpUnmap(&job->map);
+            job->mapped = false;
+            FreeMipChain(&job->chain);
+            FreeBc1Chain(&job->bc1);
+            job->ready = true;
+        }
+    }
+}
+
+bool TextureReady(GLuint tex) {
+    for (size_t i = 0; i < jobs.size(); i++)
+        if (jobs[i]->tex == tex)
+            return jobs[i]->ready && jobs[i]->level > 0;
+    return true;    // not loaded through here, so assume it is usable
+}
+
+// bytes of texture memory tex takes up once loaded (0 until then):
+int TextureBytes(GLuint tex) {
+    for (size_t i = 0; i < jobs.size(); i++)
+        if (jobs[i]->tex == tex)
+            return jobs[i]->ready ? jobs[i]->bytes : 0;
+    return 0;
+}
+
+// drop the record of a finished load, before tex is deleted (false while still loading):
+bool ForgetTexture(GLuint tex) {
+    for (size_t i = 0; i < jobs.size(); i++) {
+        if (jobs[i]->tex != tex) continue;
+        if (!jobs[i]->ready) return false;
+        delete jobs[i];
+        jobs.erase(jobs.begin() + i);
+        return true;
+    }
+    return true;
+}
+
+// the texture to bind for tex right now (the placeholder until it is complete):
+GLuint AsyncTextureName(GLuint tex) {
+    return TextureReady(tex) ? tex : placeholder;
+}
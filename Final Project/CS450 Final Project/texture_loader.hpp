@@ -0,0 +1,51 @@
+//
+//  texture_loader.hpp
+//  CS450 Final Project
+//
+
+#ifndef texture_loader_hpp
+#define texture_loader_hpp
+
+#ifdef WIN32
+#include <windows.h>
+#pragma warning(disable:4996)
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <GL/glu.h>
+#include <GL/glut.h>
+#else
+#include <GLUT/glut.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "BmpToTexture.hpp"
+#include "mipmap.hpp"
+#include "texture_cache.hpp"
+#include "trace.hpp"
+
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+
+// bytes of texture uploaded per PumpTextureUploads() call by default:
+#define UPLOAD_BYTES_PER_FRAME  (4 * 1024 * 1024)
+
+// LoadTextureAsync() flags:
+#define TEXTURE_MIPMAPS         1       // build and upload a full mip chain
+#define TEXTURE_SRGB            2       // filter the chain in linear light (the image is sRGB)
+#define TEXTURE_COMPRESSED      4       // upload as BC1, through the on-disk cache
+
+void InitTextureLoader(int workers);
+void LoadTextureAsync(char *filename, GLuint tex, int flags);
+void PumpTextureUploads(int maxBytes);
+
+bool TextureReady(GLuint tex);
+int TextureBytes(GLuint tex);
+bool ForgetTexture(GLuint tex);
+GLuint AsyncTextureName(GLuint tex);
+
+#endif /* texture_loader_hpp */
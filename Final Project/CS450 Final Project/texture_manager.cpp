@@ -0,0 +1,162 @@
+//
+//  texture_manager.cpp
+//  CS450 Final Project
+//
+//  Owns every texture loaded from a file. The same file (with the same flags)
+//  is only loaded once and handed out by reference count; a texture that has
+//  not been bound for a frame can be evicted, least recently used first, when
+//  the total goes over budget, and is loaded again the next time it is bound.
+//  Unreferenced textures stay around as a cache until they are evicted.
+//
+
+#include "texture_manager.hpp"
+#include "glut_funcs.hpp"
+
+typedef struct {
+    char filename[256];         // empty for a free slot
+    int flags;                  // TEXTURE_* options it is loaded with
+    int refs;
+    GLuint tex;                 // 0 while evicted
+    unsigned int lastUsed;      // frame it was last bound
+} ManagedTexture;
+
+std::vector<ManagedTexture> textures;       // handle h is textures[h-1]
+int                         budget = TEXTURE_BUDGET_BYTES;
+unsigned int                frame = 0;
+
+void cleanTextureManager() {
+    puts("Cleaning texture manager resources");
+
+    for (size_t i = 0; i < textures.size(); i++)
+        if (textures[i].tex != 0)
+            glDeleteTextures(1, &textures[i].tex);
+    textures.clear();
+}
+
+void InitTextureManager(int budgetBytes) {
+    budget = budgetBytes;
+    atexit(cleanTextureManager);
+}
+
+void SetTextureBudget(int budgetBytes) {
+    budget = budgetBytes;
+}
+
+// make a texture name with the usual parameters and start it loading:
+void loadManaged(ManagedTexture *t) {
+    glGenTextures(1, &t->tex);
+    glBindTexture(GL_TEXTURE_2D, t->tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, (t->flags & TEXTURE_MIPMAPS) ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    LoadTextureAsync(t->filename, t->tex, t->flags);
+}
+
+// delete the GL texture (false if it is still loading and cannot go yet):
+bool evictManaged(ManagedTexture *t) {
+    if (t->tex == 0) return true;
+    if (!ForgetTexture(t->tex)) return false;
+    glDeleteTextures(1, &t->tex);
+    t->tex = 0;
+    return true;
+}
+
+/**
+ ** get a handle to the texture in filename, loading it if nobody has yet
+ ** (release it with ReleaseTexture when done):
+ **/
+TextureHandle AcquireTexture(char *filename, int flags) {
+    int freeSlot = -1;
+    for (size_t i = 0; i < textures.size(); i++) {
+        ManagedTexture *t = &textures[i];
+        if (t->filename[0] == '\0') {
+            if (freeSlot < 0) freeSlot = (int)i;
+        } else if (t->flags == flags && strcmp(t->filename, filename) == 0) {
+            t->refs++;
+            return (TextureHandle)i + 1;
+        }
+    }
+
+    if (freeSlot < 0) {
+        ManagedTexture empty;
+        memset(&empty, 0, sizeof(empty));
+        textures.push_back(empty);
+        freeSlot = (int)textures.size() - 1;
+    }
+
+    ManagedTexture *t = &textures[freeSlot];
+    memset(t, 0, sizeof(ManagedTexture));
+    strncpy(t->filename, filename, sizeof(t->filename) - 1);
+    t->flags = flags;
+    t->refs = 1;
+    t->lastUsed = frame;
+    loadManaged(t);
+    return (TextureHandle)freeSlot + 1;
+}
+
+// drop a reference (the texture stays cached until the budget needs the room):
+void ReleaseTexture(TextureHandle handle) {
+    if (handle < 1 || handle > (int)textures.size()) return;
+    ManagedTexture *t = &textures[handle - 1];
+    if (t->refs > 0) t->refs--;
+}
+
+/**
+ ** bind the texture (or the placeholder while it loads), and mark it used this frame;
+ ** an evicted texture starts loading again
+ **/
+void BindTexture(TextureHandle handle) {
+    if (handle < 1 || handle > (int)textures.size() || textures[handle - 1].filename[0] == '\0') {
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return;
+    }
+
+    ManagedTexture *t = &textures[handle - 1];
+    if (t->tex == 0)
+        loadManaged(t);
+    t->lastUsed = frame;
+    glBindTexture(GL_TEXTURE_2D, AsyncTextureName(t->tex));
+}
+
+int ResidentTextureBytes() {
+    int total = 0;
+    for (size_t i = 0; i < textures.size(); i++)
+        if (textures[i].tex != 0)
+            total += TextureBytes(textures[i].tex);
+    return total;
+}
+
+/**
+ ** once per frame: feed pending uploads, then evict until under budget
+ ** (unreferenced textures first, then by age; anything bound last frame stays)
+ **/
+void UpdateTextures() {
+    PumpTextureUploads(UPLOAD_BYTES_PER_FRAME);
+
+    int resident = ResidentTextureBytes();
+    while (resident > budget) {
+        ManagedTexture *victim = NULL;
+        for (size_t i = 0; i < textures.size(); i++) {
+            ManagedTexture *t = &textures[i];
+            if (t->tex == 0 || frame - t->lastUsed < 2 || TextureBytes(t->tex) == 0)
+                continue;
+            if (victim == NULL || (t->refs == 0) > (victim->refs == 0) ||
+                ((t->refs == 0) == (victim->refs == 0) && t->lastUsed < victim->lastUsed))
+                victim = t;
+        }
+        if (victim == NULL) break;
+
+        int bytes = TextureBytes(victim->tex);
+        if (DebugOn)
+            fprintf(stderr, "Evicting texture '%s' (%d KB)\n", victim->filename, bytes / 1024);
+        if (!evictManaged(victim)) break;
+        resident -= bytes;
+
+        // nobody holds it, so forget it altogether
+        if (victim->refs == 0)
+            victim->filename[0] = '\0';
+    }
+
+    frame++;
+}
@@ -0,0 +1,30 @@
+//
+//  texture_manager.hpp
+//  CS450 Final Project
+//
+
+#ifndef texture_manager_hpp
+#define texture_manager_hpp
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "texture_loader.hpp"
+
+// default texture memory allowed before least recently used textures are evicted:
+#define TEXTURE_BUDGET_BYTES    (256 * 1024 * 1024)
+
+// a reference to a managed texture (0 is no texture):
+typedef int TextureHandle;
+
+void InitTextureManager(int budgetBytes);
+void SetTextureBudget(int budgetBytes);
+
+TextureHandle AcquireTexture(char *filename, int flags);
+void ReleaseTexture(TextureHandle handle);
+void BindTexture(TextureHandle handle);
+void UpdateTextures();
+
+int ResidentTextureBytes();
+
+#endif /* texture_manager_hpp */
@@ -0,0 +1,167 @@
+//
+//  trace.cpp
+//  CS450 Final Project
+//
+//  Flight recorder for zones on every thread, saved on demand as Chrome
+//  trace-event JSON (chrome://tracing, ui.perfetto.dev). Each thread writes
+//  complete events into its own ring, so recording never takes a lock: the
+//  only shared thing is the ring's head, which is published after the event is
+//  filled in. A dump pauses recording, reads every ring up to its head (minus
+//  a margin for a write that was already under way), then carries on.
+//
+
+#include "trace.hpp"
+
+typedef std::chrono::steady_clock TraceClock;
+
+typedef struct {
+    const char *name;
+    long long start, duration;              // ns since the trace started
+} TraceEvent;
+
+// one thread's events (only that thread writes them):
+typedef struct {
+    int tid;
+    char name[32];
+    std::atomic<unsigned long long> head;   // events ever written; the next goes in head % TRACE_EVENTS
+    TraceEvent events[TRACE_EVENTS];
+} TraceBuffer;
+
+// an open zone:
+typedef struct {
+    const char *name;
+    long long start;                        // -1 if it opened while not recording
+} TraceMark;
+
+std::atomic<bool>           TraceOn(false);
+
+TraceClock::time_point      traceEpoch;
+std::mutex                  traceLock;      // guards the list of buffers, not the buffers
+std::vector<TraceBuffer*>   traceBuffers;
+int                         nextTid = 1;
+
+thread_local TraceBuffer    *traceLocal = NULL;
+thread_local TraceMark      traceMarks[TRACE_MAX_DEPTH];
+thread_local int            traceDepth = 0;
+
+void cleanTrace() {
+    puts("Cleaning trace resources");
+
+    TraceOn = false;
+    std::lock_guard<std::mutex> lock(traceLock);
+    for (size_t i = 0; i < traceBuffers.size(); i++)
+        delete traceBuffers[i];
+    traceBuffers.clear();
+}
+
+// start recording (the calling thread is the render thread):
+void InitTrace() {
+    traceEpoch = TraceClock::now();
+    traceThreadName("Render");
+    TraceOn = true;
+
+    atexit(cleanTrace);
+}
+
+static long long traceNow() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(TraceClock::now() - traceEpoch).count();
+}
+
+// this thread's ring, made the first time the thread records anything:
+static TraceBuffer* localBuffer() {
+    if (traceLocal == NULL) {
+        TraceBuffer *buffer = new TraceBuffer();
+        buffer->head = 0;
+        std::lock_guard<std::mutex> lock(traceLock);
+        buffer->tid = nextTid++;
+        snprintf(buffer->name, sizeof(buffer->name), "Thread %d", buffer->tid);
+        traceBuffers.push_back(buffer);
+        traceLocal = buffer;
+    }
+    return traceLocal;
+}
+
+// what the viewer calls this thread:
+void traceThreadName(const char *name) {
+    TraceBuffer *buffer = localBuffer();
+    std::lock_guard<std::mutex> lock(traceLock);
+    strncpy(buffer->name, name, sizeof(buffer->name) - 1);
+}
+
+void traceBegin(const char *name) {
+    if (traceDepth < TRACE_MAX_DEPTH) {
+        traceMarks[traceDepth].name = name;
+        traceMarks[traceDepth].start = TraceOn.load(std::memory_order_relaxed) ? traceNow() : -1;
+    }
+    traceDepth++;
+}
+
+void traceEnd() {
+    if (traceDepth == 0) return;
+    if (--traceDepth >= TRACE_MAX_DEPTH) return;
+
+    TraceMark *mark = &traceMarks[traceDepth];
+    // (acquire: slots a dump has read are only reused once it has finished with them)
+    if (mark->start < 0 || !TraceOn.load(std::memory_order_acquire)) return;
+
+    TraceBuffer *buffer = localBuffer();
+    unsigned long long head = buffer->head.load(std::memory_order_relaxed);
+    TraceEvent *event = &buffer->events[head % TRACE_EVENTS];
+    event->name = mark->name;
+    event->start = mark->start;
+    event->duration = traceNow() - mark->start;
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+// a JSON string (zone names are plain, but quotes would break the file):
+static void writeString(FILE *fp, const char *s) {
+    fputc('"', fp);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') fputc('\\', fp);
+        if ((unsigned char)*s >= ' ') fputc(*s, fp);
+    }
+    fputc('"', fp);
+}
+
+/**
+ ** everything still in the rings, as trace-event JSON: one complete ("X") event
+ ** per zone in microseconds, with the thread names as metadata
+ **/
+bool DumpTrace(const char *filename) {
+    FILE *fp = fopen(filename, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "Cannot write trace file '%s'\n", filename);
+        return false;
+    }
+
+    bool recording = TraceOn.exchange(false);
+    int events = 0;
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"Music Visualizer\"}}");
+    {
+        std::lock_guard<std::mutex> lock(traceLock);
+        for (size_t i = 0; i < traceBuffers.size(); i++) {
+            TraceBuffer *buffer = traceBuffers[i];
+            fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", buffer->tid);
+            writeString(fp, buffer->name);
+            fprintf(fp, "}}");
+
+            unsigned long long head = buffer->head.load(std::memory_order_acquire);
+            unsigned long long first = (head > TRACE_EVENTS - TRACE_MARGIN) ? head - (TRACE_EVENTS - TRACE_MARGIN) : 0;
+            for (unsigned long long e = first; e < head; e++) {
+                TraceEvent *event = &buffer->events[e % TRACE_EVENTS];
+                fprintf(fp, ",\n{\"name\":");
+                writeString(fp, event->name);
+                fprintf(fp, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                        buffer->tid, event->start / 1e3, event->duration / 1e3);
+                events++;
+            }
+        }
+    }
+    fprintf(fp, "\n]}\n");
+    fclose(fp);
+    TraceOn = recording;
+
+    fprintf(stderr, "Trace: %d events written to %s\n", events, filename);
+    return true;
+}
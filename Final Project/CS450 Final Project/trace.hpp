@@ -0,0 +1,47 @@
+//
+//  trace.hpp
+//  CS450 Final Project
+//
+
+#ifndef trace_hpp
+#define trace_hpp
+
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+// events each thread keeps (the newest win; ~10 s of the render thread at 60 fps):
+#define TRACE_EVENTS        16384
+// newest events left out of a dump, in case a thread is still writing them:
+#define TRACE_MARGIN        64
+// how deep zones nest on one thread:
+#define TRACE_MAX_DEPTH     16
+#define TRACE_FILE          "musicvisualizer-trace.json"
+
+extern std::atomic<bool> TraceOn;
+
+void InitTrace();
+void traceThreadName(const char *name);
+void traceBegin(const char *name);
+void traceEnd();
+bool DumpTrace(const char *filename);
+
+/**
+ ** records the enclosing block on this thread (any thread); the name must
+ ** outlive the trace (a string literal):
+ **     { TRACE_ZONE("Decode texture"); ... }
+ ** render thread zones come through PROFILE_ZONE, which traces as well
+ **/
+class TraceScope {
+public:
+    explicit TraceScope(const char *name) { traceBegin(name); }
+    ~TraceScope() { traceEnd(); }
+};
+#define TRACE_CONCAT2(a, b)     a##b
+#define TRACE_CONCAT(a, b)      TRACE_CONCAT2(a, b)
+#define TRACE_ZONE(name)        TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+
+#endif /* trace_hpp */
@@ -8,6 +8,10 @@
 
 #include "utility_funcs.hpp"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 
 //float inline rerange(float val, float OldMin, float OldMax, float NewMin, float NewMax) {
 //    return (((float)(val - OldMin) * (NewMax - NewMin)) / (float)(OldMax - OldMin)) + NewMin;
@@ -92,67 +96,124 @@ void HsvRgb(float hsv[3], float rgb[3]) {
     rgb[2] = b;
 }
 
-float Dot(float v1[3], float v2[3]) {
-    return v1[0]*v2[0] + v1[1]*v2[1] + v1[2]*v2[2];
+
+// MARK: - Batches
+
+/**
+ ** HsvRgb() without the switch: channel n (5, 3 and 1 for r, g and b) is
+ **     v - v*s*clamp(min(k, 4-k), 0, 1)     with k = (n + h/60) mod 6
+ ** which is the same colour, and only adds, multiplies and clamps, so four
+ ** colours go through at once
+ **/
+inline float hsvChannel(float n, float h, float s, float v) {
+    float k = n + h;
+    if (k >= 6.f) k -= 6.f;
+    float f = std::max(std::min(std::min(k, 4.f - k), 1.f), 0.f);
+    return v - v * s * f;
 }
 
-void Cross(float v1[3], float v2[3], float vout[3]) {
-    float tmp[3];
-    tmp[0] = v1[1]*v2[2] - v2[1]*v1[2];
-    tmp[1] = v2[0]*v1[2] - v1[0]*v2[2];
-    tmp[2] = v1[0]*v2[1] - v2[0]*v1[1];
-    vout[0] = tmp[0];
-    vout[1] = tmp[1];
-    vout[2] = tmp[2];
+inline void hsvToRgb(const float *hsv, float *r, float *g, float *b) {
+    float h = hsv[0] / 60.f;
+    h -= 6.f * floorf(h / 6.f);
+    float s = std::max(std::min(hsv[1], 1.f), 0.f);
+    float v = std::max(std::min(hsv[2], 1.f), 0.f);
+    *r = hsvChannel(5.f, h, s, v);
+    *g = hsvChannel(3.f, h, s, v);
+    *b = hsvChannel(1.f, h, s, v);
 }
 
-float Unit(float vin[3], float vout[3]) {
-    float dist = vin[0]*vin[0] + vin[1]*vin[1] + vin[2]*vin[2];
-    if (dist > 0.0) {
-        dist = sqrt( dist );
-        vout[0] = vin[0] / dist;
-        vout[1] = vin[1] / dist;
-        vout[2] = vin[2] / dist;
-    } else {
-        vout[0] = vin[0];
-        vout[1] = vin[1];
-        vout[2] = vin[2];
-    }
-    return dist;
+#ifdef __SSE2__
+// rounds toward minus infinity (for hues within an int of zero):
+inline __m128 floor4(__m128 x) {
+    __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+    return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, x), _mm_set1_ps(1.f)));
 }
 
-float* Array3(float a, float b, float c) {
-    static float array[4];
-    array[0] = a;
-    array[1] = b;
-    array[2] = c;
-    array[3] = 1.;
-    return array;
+inline __m128 hsvChannel4(float n, __m128 h, __m128 vs, __m128 v) {
+    __m128 six = _mm_set1_ps(6.f);
+    __m128 k = _mm_add_ps(_mm_set1_ps(n), h);
+    k = _mm_sub_ps(k, _mm_and_ps(_mm_cmpge_ps(k, six), six));
+    __m128 f = _mm_min_ps(_mm_min_ps(k, _mm_sub_ps(_mm_set1_ps(4.f), k)), _mm_set1_ps(1.f));
+    f = _mm_max_ps(f, _mm_setzero_ps());
+    return _mm_sub_ps(v, _mm_mul_ps(vs, f));
 }
 
-float* Array4(float a, float b, float c, float d) {
-    static float array[4];
-    array[0] = a;
-    array[1] = b;
-    array[2] = c;
-    array[3] = d;
-    return array;
+/**
+ ** four hsv triples in (12 floats, loaded as h0 s0 v0 h1 | s1 v1 h2 s2 | v2 h3 s3 v3),
+ ** their r, g and b out, one colour per lane
+ **/
+inline void hsvToRgb4(const float *hsv, __m128 *r, __m128 *g, __m128 *b) {
+    __m128 a = _mm_loadu_ps(hsv), m = _mm_loadu_ps(hsv + 4), c = _mm_loadu_ps(hsv + 8);
+
+    __m128 h = _mm_shuffle_ps(a, _mm_shuffle_ps(m, c, _MM_SHUFFLE(1,1,2,2)), _MM_SHUFFLE(2,0,3,0));
+    __m128 s = _mm_shuffle_ps(_mm_shuffle_ps(a, m, _MM_SHUFFLE(0,0,1,1)),
+                              _mm_shuffle_ps(m, c, _MM_SHUFFLE(2,2,3,3)), _MM_SHUFFLE(2,0,2,0));
+    __m128 v = _mm_shuffle_ps(_mm_shuffle_ps(a, m, _MM_SHUFFLE(1,1,2,2)),
+                              _mm_shuffle_ps(c, c, _MM_SHUFFLE(3,3,0,0)), _MM_SHUFFLE(2,0,2,0));
+
+    __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.f);
+    h = _mm_mul_ps(h, _mm_set1_ps(1.f / 60.f));
+    h = _mm_sub_ps(h, _mm_mul_ps(_mm_set1_ps(6.f), floor4(_mm_mul_ps(h, _mm_set1_ps(1.f / 6.f)))));
+    s = _mm_max_ps(_mm_min_ps(s, one), zero);
+    v = _mm_max_ps(_mm_min_ps(v, one), zero);
+
+    __m128 vs = _mm_mul_ps(v, s);
+    *r = hsvChannel4(5.f, h, vs, v);
+    *g = hsvChannel4(3.f, h, vs, v);
+    *b = hsvChannel4(1.f, h, vs, v);
 }
+#endif
+
+// count hsv triples (hue in degrees, any value) to rgb triples, as HsvRgb() would:
+void HsvRgbBatch(const float *hsv, float *rgb, int count) {
+    int i = 0;
 
-float* BlendArray3(float factor, float array0[3], float array1[3]) {
-    static float array[4];
-    array[0] = factor * array0[0]  +  (1.f - factor) * array1[0];
-    array[1] = factor * array0[1]  +  (1.f - factor) * array1[1];
-    array[2] = factor * array0[2]  +  (1.f - factor) * array1[2];
-    array[3] = 1.;
-    return array;
+#ifdef __SSE2__
+    for (; i + 4 <= count; i += 4) {
+        __m128 r, g, b;
+        hsvToRgb4(&hsv[3*i], &r, &g, &b);
+
+        // back to r0 g0 b0 r1 | g1 b1 r2 g2 | b2 r3 g3 b3
+        _mm_storeu_ps(&rgb[3*i], _mm_shuffle_ps(_mm_shuffle_ps(r, g, _MM_SHUFFLE(0,0,0,0)),
+                                                _mm_shuffle_ps(b, r, _MM_SHUFFLE(1,1,0,0)), _MM_SHUFFLE(2,0,2,0)));
+        _mm_storeu_ps(&rgb[3*i + 4], _mm_shuffle_ps(_mm_shuffle_ps(g, b, _MM_SHUFFLE(1,1,1,1)),
+                                                    _mm_shuffle_ps(r, g, _MM_SHUFFLE(2,2,2,2)), _MM_SHUFFLE(2,0,2,0)));
+        _mm_storeu_ps(&rgb[3*i + 8], _mm_shuffle_ps(_mm_shuffle_ps(b, r, _MM_SHUFFLE(3,3,2,2)),
+                                                    _mm_shuffle_ps(g, b, _MM_SHUFFLE(3,3,3,3)), _MM_SHUFFLE(2,0,2,0)));
+    }
+#endif
+
+    // whatever is left (everything without SSE):
+    for (; i < count; i++)
+        hsvToRgb(&hsv[3*i], &rgb[3*i], &rgb[3*i + 1], &rgb[3*i + 2]);
 }
 
-float* MulArray3(float factor, float array0[3]) {
-    static float array[4];
-    array[0] = factor * array0[0];
-    array[1] = factor * array0[1];
-    array[2] = factor * array0[2];
-    array[3] = 1.;
-    return array;
+// the same, straight to 8 bit RGBA with one alpha for all (ready for glColor4ubv or a color array):
+void HsvRgba8Batch(const float *hsv, unsigned char *rgba, int count, unsigned char alpha) {
+    int i = 0;
+
+#ifdef __SSE2__
+    __m128 scale = _mm_set1_ps(255.f), half = _mm_set1_ps(.5f);
+    __m128i a = _mm_set1_epi32((int)((unsigned)alpha << 24));
+    for (; i + 4 <= count; i += 4) {
+        __m128 r, g, b;
+        hsvToRgb4(&hsv[3*i], &r, &g, &b);
+
+        // each lane becomes one little-endian r | g << 8 | b << 16 | a << 24
+        __m128i ri = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(r, scale), half));
+        __m128i gi = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(g, scale), half));
+        __m128i bi = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(b, scale), half));
+        __m128i px = _mm_or_si128(_mm_or_si128(ri, _mm_slli_epi32(gi, 8)), _mm_or_si128(_mm_slli_epi32(bi, 16), a));
+        _mm_storeu_si128((__m128i*)&rgba[4*i], px);
+    }
+#endif
+
+    for (; i < count; i++) {
+        float r, g, b;
+        hsvToRgb(&hsv[3*i], &r, &g, &b);
+        rgba[4*i]     = (unsigned char)(r * 255.f + .5f);
+        rgba[4*i + 1] = (unsigned char)(g * 255.f + .5f);
+        rgba[4*i + 2] = (unsigned char)(b * 255.f + .5f);
+        rgba[4*i + 3] = alpha;
+    }
 }
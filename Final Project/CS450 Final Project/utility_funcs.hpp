@@ -22,18 +22,13 @@
 
 #include <stdio.h>
 #include <cmath>
+#include <algorithm>
+#include "vecmath.hpp"
 
 #define rerange(val, OldMin, OldMax, NewMin, NewMax) (((float)(val - OldMin) * (NewMax - NewMin)) / (float)(OldMax - OldMin)) + NewMin
 
 void HsvRgb(float hsv[3], float rgb[3]);
-
-float Dot(float v1[3], float v2[3]);
-void Cross(float v1[3], float v2[3], float vout[3]);
-float Unit(float vin[3], float vout[3]);
-
-float* Array3(float a, float b, float c);
-float* Array4(float a, float b, float c, float d);
-float* BlendArray3(float factor, float array0[3], float array1[3]);
-float* MulArray3(float factor, float array0[3]);
+void HsvRgbBatch(const float *hsv, float *rgb, int count);
+void HsvRgba8Batch(const float *hsv, unsigned char *rgba, int count, unsigned char alpha);
 
 #endif /* utility_funcs_hpp */
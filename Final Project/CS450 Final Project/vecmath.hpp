@@ -0,0 +1,205 @@
+//
+//  vecmath.hpp
+//  CS450 Final Project
+//
+//  Small vector and matrix types that are passed and returned by value: no
+//  static buffers, so any number can appear in one expression and they work
+//  on any thread. vec3 stays 3 floats so it can sit in vertex arrays; vec4 and
+//  mat4 are 16 byte aligned and use SSE when it is there. Each converts to
+//  the float* GL wants:
+//      glLightfv(GL_LIGHT0, GL_POSITION, vec4(x, y, z, 1.));
+//
+
+#ifndef vecmath_hpp
+#define vecmath_hpp
+
+#include <cmath>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+
+// MARK: - vec3
+
+struct vec3 {
+    float x, y, z;
+
+    constexpr vec3() : x(0.f), y(0.f), z(0.f) {}
+    constexpr vec3(float a, float b, float c) : x(a), y(b), z(c) {}
+    explicit vec3(const float *v) : x(v[0]), y(v[1]), z(v[2]) {}
+
+    operator float*() { return &x; }
+    operator const float*() const { return &x; }
+
+    vec3& operator+=(vec3 b) { x += b.x;  y += b.y;  z += b.z;  return *this; }
+    vec3& operator-=(vec3 b) { x -= b.x;  y -= b.y;  z -= b.z;  return *this; }
+    vec3& operator*=(float s) { x *= s;  y *= s;  z *= s;  return *this; }
+};
+
+constexpr vec3 operator+(vec3 a, vec3 b) { return vec3(a.x + b.x, a.y + b.y, a.z + b.z); }
+constexpr vec3 operator-(vec3 a, vec3 b) { return vec3(a.x - b.x, a.y - b.y, a.z - b.z); }
+constexpr vec3 operator-(vec3 a) { return vec3(-a.x, -a.y, -a.z); }
+constexpr vec3 operator*(vec3 a, vec3 b) { return vec3(a.x * b.x, a.y * b.y, a.z * b.z); }
+constexpr vec3 operator*(float s, vec3 a) { return vec3(s * a.x, s * a.y, s * a.z); }
+constexpr vec3 operator*(vec3 a, float s) { return vec3(s * a.x, s * a.y, s * a.z); }
+constexpr vec3 operator/(vec3 a, float s) { return vec3(a.x / s, a.y / s, a.z / s); }
+
+constexpr float dot(vec3 a, vec3 b) {
+    return a.x*b.x + a.y*b.y + a.z*b.z;
+}
+
+constexpr vec3 cross(vec3 a, vec3 b) {
+    return vec3(a.y*b.z - b.y*a.z, b.x*a.z - a.x*b.z, a.x*b.y - b.x*a.y);
+}
+
+// t of the way from a to b:
+constexpr vec3 mix(vec3 a, vec3 b, float t) {
+    return a + t * (b - a);
+}
+
+inline float length(vec3 a) {
+    return sqrtf(dot(a, a));
+}
+
+// a at unit length (a zero vector comes back as it is):
+inline vec3 normalize(vec3 a) {
+    float len = length(a);
+    return (len > 0.f) ? a / len : a;
+}
+
+
+// MARK: - vec4
+
+struct alignas(16) vec4 {
+    float x, y, z, w;
+
+    constexpr vec4() : x(0.f), y(0.f), z(0.f), w(0.f) {}
+    constexpr vec4(float a, float b, float c, float d) : x(a), y(b), z(c), w(d) {}
+    constexpr vec4(vec3 v, float d) : x(v.x), y(v.y), z(v.z), w(d) {}
+    explicit vec4(const float *v) : x(v[0]), y(v[1]), z(v[2]), w(v[3]) {}
+#ifdef __SSE__
+    explicit vec4(__m128 m) { _mm_store_ps(&x, m); }
+    __m128 simd() const { return _mm_load_ps(&x); }
+#endif
+
+    constexpr vec3 xyz() const { return vec3(x, y, z); }
+
+    operator float*() { return &x; }
+    operator const float*() const { return &x; }
+};
+
+inline vec4 operator+(vec4 a, vec4 b) {
+#ifdef __SSE__
+    return vec4(_mm_add_ps(a.simd(), b.simd()));
+#else
+    return vec4(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w);
+#endif
+}
+
+inline vec4 operator-(vec4 a, vec4 b) {
+#ifdef __SSE__
+    return vec4(_mm_sub_ps(a.simd(), b.simd()));
+#else
+    return vec4(a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w);
+#endif
+}
+
+inline vec4 operator*(vec4 a, vec4 b) {
+#ifdef __SSE__
+    return vec4(_mm_mul_ps(a.simd(), b.simd()));
+#else
+    return vec4(a.x * b.x, a.y * b.y, a.z * b.z, a.w * b.w);
+#endif
+}
+
+inline vec4 operator*(vec4 a, float s) {
+#ifdef __SSE__
+    return vec4(_mm_mul_ps(a.simd(), _mm_set1_ps(s)));
+#else
+    return vec4(s * a.x, s * a.y, s * a.z, s * a.w);
+#endif
+}
+
+inline vec4 operator*(float s, vec4 a) {
+    return a * s;
+}
+
+inline float dot(vec4 a, vec4 b) {
+#ifdef __SSE__
+    __m128 m = _mm_mul_ps(a.simd(), b.simd());
+    m = _mm_add_ps(m, _mm_movehl_ps(m, m));             // x+z, y+w
+    return _mm_cvtss_f32(_mm_add_ss(m, _mm_shuffle_ps(m, m, 1)));
+#else
+    return a.x*b.x + a.y*b.y + a.z*b.z + a.w*b.w;
+#endif
+}
+
+
+// MARK: - mat4
+
+// column major, the way GL stores matrices (so c[3] is the translation):
+struct alignas(16) mat4 {
+    vec4 c[4];
+
+    constexpr mat4() : c{ vec4(1.f, 0.f, 0.f, 0.f), vec4(0.f, 1.f, 0.f, 0.f), vec4(0.f, 0.f, 1.f, 0.f), vec4(0.f, 0.f, 0.f, 1.f) } {}
+    constexpr mat4(vec4 c0, vec4 c1, vec4 c2, vec4 c3) : c{ c0, c1, c2, c3 } {}
+    explicit mat4(const float *m) : c{ vec4(&m[0]), vec4(&m[4]), vec4(&m[8]), vec4(&m[12]) } {}
+
+    // e.g. glGetFloatv(GL_MODELVIEW_MATRIX, m) and glLoadMatrixf(m)
+    operator float*() { return &c[0].x; }
+    operator const float*() const { return &c[0].x; }
+};
+
+inline vec4 operator*(const mat4 &m, vec4 v) {
+#ifdef __SSE__
+    __m128 r = _mm_mul_ps(m.c[0].simd(), _mm_set1_ps(v.x));
+    r = _mm_add_ps(r, _mm_mul_ps(m.c[1].simd(), _mm_set1_ps(v.y)));
+    r = _mm_add_ps(r, _mm_mul_ps(m.c[2].simd(), _mm_set1_ps(v.z)));
+    r = _mm_add_ps(r, _mm_mul_ps(m.c[3].simd(), _mm_set1_ps(v.w)));
+    return vec4(r);
+#else
+    return m.c[0] * v.x + m.c[1] * v.y + m.c[2] * v.z + m.c[3] * v.w;
+#endif
+}
+
+inline mat4 operator*(const mat4 &a, const mat4 &b) {
+    return mat4(a * b.c[0], a * b.c[1], a * b.c[2], a * b.c[3]);
+}
+
+// a position (w = 1) and a direction (w = 0) through m:
+inline vec3 transformPoint(const mat4 &m, vec3 p) {
+    return (m * vec4(p, 1.f)).xyz();
+}
+
+inline vec3 transformVector(const mat4 &m, vec3 v) {
+    return (m * vec4(v, 0.f)).xyz();
+}
+
+inline mat4 transpose(const mat4 &m) {
+    return mat4(vec4(m.c[0].x, m.c[1].x, m.c[2].x, m.c[3].x),
+                vec4(m.c[0].y, m.c[1].y, m.c[2].y, m.c[3].y),
+                vec4(m.c[0].z, m.c[1].z, m.c[2].z, m.c[3].z),
+                vec4(m.c[0].w, m.c[1].w, m.c[2].w, m.c[3].w));
+}
+
+// the matrices glTranslatef, glScalef and glRotatef multiply by:
+constexpr mat4 translate(vec3 t) {
+    return mat4(vec4(1.f, 0.f, 0.f, 0.f), vec4(0.f, 1.f, 0.f, 0.f), vec4(0.f, 0.f, 1.f, 0.f), vec4(t, 1.f));
+}
+
+constexpr mat4 scale(vec3 s) {
+    return mat4(vec4(s.x, 0.f, 0.f, 0.f), vec4(0.f, s.y, 0.f, 0.f), vec4(0.f, 0.f, s.z, 0.f), vec4(0.f, 0.f, 0.f, 1.f));
+}
+
+inline mat4 rotate(float degrees, vec3 axis) {
+    vec3 a = normalize(axis);
+    float rad = degrees * (float)M_PI / 180.f;
+    float c = cosf(rad), s = sinf(rad), k = 1.f - c;
+    return mat4(vec4(a.x*a.x*k + c,      a.y*a.x*k + a.z*s,  a.z*a.x*k - a.y*s,  0.f),
+                vec4(a.x*a.y*k - a.z*s,  a.y*a.y*k + c,      a.z*a.y*k + a.x*s,  0.f),
+                vec4(a.x*a.z*k + a.y*s,  a.y*a.z*k - a.x*s,  a.z*a.z*k + c,      0.f),
+                vec4(0.f, 0.f, 0.f, 1.f));
+}
+
+#endif /* vecmath_hpp */
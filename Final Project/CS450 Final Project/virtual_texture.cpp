@@ -0,0 +1,630 @@
+//
+//  virtual_texture.cpp
+//  CS450 Final Project
+//
+//  Draws the globe from an equirectangular map far bigger than one texture
+//  can hold. BuildVirtualTexture() cuts the map into 256 x 256 tiles at every
+//  level of detail and packs them into one file; at run time only the tiles
+//  facing the camera, at the level the sphere's size on screen calls for, are
+//  read (by a thread) and copied into slots of a fixed 4096 x 4096 cache
+//  texture. The indirection table says which slot holds each tile; with no
+//  shaders to look it up per pixel, the sphere is drawn a tile at a time with
+//  texture coordinates pointing into that tile's slot. A tile that has not
+//  arrived yet is drawn from the part of its nearest cached ancestor over it,
+//  and the coarsest level is read up front and never evicted.
+//
+
+#include "virtual_texture.hpp"
+
+#ifdef WIN32
+#define fseeko _fseeki64
+#endif
+
+// tile pack layout: this header, then each level's tiles, finest level first,
+// each level a row of tiles at a time from the bottom left (south west)
+typedef struct {
+    char magic[4];              // "VTEX"
+    int version;
+    int width, height;          // the source image
+    int tileSize;
+    int numLevels;
+    int tilesX[VT_MAX_LEVELS], tilesY[VT_MAX_LEVELS];
+    long long offset[VT_MAX_LEVELS];    // file position of each level's first tile
+} VtHeader;
+
+#define VT_TILE_BYTES   (3 * VT_TILE_SIZE * VT_TILE_SIZE)
+#define VT_NUM_SLOTS    (VT_CACHE_SLOTS * VT_CACHE_SLOTS)
+
+// pixels of a BMP as the builder reads them, bottom row first:
+typedef struct {
+    unsigned char *rows;
+    int width, height;
+    size_t rowbytes;
+    int bpp;                    // 3 or 4
+    bool bgr;                   // blue first (straight out of the file)
+} VtSource;
+
+// one entry of the indirection table:
+typedef struct {
+    short slot;                 // cache slot holding it, or -1
+    bool requested;             // queued for (or being read by) the reader
+} VtTile;
+
+// one slot of the cache texture:
+typedef struct {
+    int level, x, y;            // tile held, level -1 while free
+    unsigned int lastUsed;      // frame it was last drawn from
+    bool pinned;                // coarsest level: never evicted
+} VtSlot;
+
+// a tile to read, and then the texels read:
+typedef struct {
+    int level, x, y;
+    unsigned char *pixels;      // NULL until read (or if it could not be)
+} VtRead;
+
+VtHeader                    vtHeader;
+FILE                        *vtFile = NULL;     // read by the reader thread once it starts
+std::vector<VtTile>         vtTiles[VT_MAX_LEVELS];
+VtSlot                      vtSlots[VT_NUM_SLOTS];
+GLuint                      vtCache = 0;
+unsigned int                vtFrame = 0;
+bool                        vtReady = false;
+
+std::deque<VtRead>          vtRequests;         // tiles waiting for the reader
+std::deque<VtRead>          vtDone;             // tiles read, waiting for upload
+std::thread                 vtReader;
+std::mutex                  vtLock;             // guards vtRequests and vtDone
+std::condition_variable     vtWaiting;
+bool                        stopReader = false;
+
+
+long long tileOffset(VtHeader *header, int level, int x, int y) {
+    return header->offset[level] + ((long long)y * header->tilesX[level] + x) * VT_TILE_BYTES;
+}
+
+bool readTile(FILE *fp, VtHeader *header, int level, int x, int y, unsigned char *pixels) {
+    return fseeko(fp, tileOffset(header, level, x, y), SEEK_SET) == 0 &&
+           fread(pixels, VT_TILE_BYTES, 1, fp) == 1;
+}
+
+int nextPowerOfTwo(int n) {
+    int p = 1;
+    while (p < n) p *= 2;
+    return p;
+}
+
+
+// MARK: - Building
+
+/**
+ ** cut level 0 out of the source a row of tiles at a time (reading the source
+ ** in order), stretched to the whole number of tiles and turned RGB:
+ **/
+bool writeBaseLevel(FILE *fp, VtSource *src, int tilesX, int tilesY) {
+    long long W = (long long)tilesX * VT_TILE_SIZE, H = (long long)tilesY * VT_TILE_SIZE;
+    std::vector<int> column(W);
+    for (long long X = 0; X < W; X++)
+        column[X] = (int)(X * src->width / W);
+
+    int r0 = src->bgr ? 2 : 0, r2 = src->bgr ? 0 : 2;
+    std::vector<unsigned char> band((size_t)tilesX * VT_TILE_BYTES);
+    for (int ty = 0; ty < tilesY; ty++) {
+        for (int r = 0; r < VT_TILE_SIZE; r++) {
+            long long row = (long long)ty * VT_TILE_SIZE + r;
+            unsigned char *line = src->rows + (size_t)(row * src->height / H) * src->rowbytes;
+            for (int tx = 0; tx < tilesX; tx++) {
+                unsigned char *dst = &band[(size_t)tx * VT_TILE_BYTES + 3 * r * VT_TILE_SIZE];
+                int *cols = &column[(size_t)tx * VT_TILE_SIZE];
+                for (int c = 0; c < VT_TILE_SIZE; c++) {
+                    unsigned char *p = line + (size_t)src->bpp * cols[c];
+                    dst[3*c + 0] = p[r0];
+                    dst[3*c + 1] = p[1];
+                    dst[3*c + 2] = p[r2];
+                }
+            }
+        }
+        if (fwrite(&band[0], band.size(), 1, fp) != 1)
+            return false;
+    }
+    return true;
+}
+
+// each tile of a coarser level is the 2 x 2 box average of the four tiles under it:
+bool writeCoarserLevel(FILE *fp, VtHeader *header, int level) {
+    const int T = VT_TILE_SIZE, half = VT_TILE_SIZE / 2;
+    std::vector<unsigned char> child(VT_TILE_BYTES), parent(VT_TILE_BYTES);
+
+    for (int y = 0; y < header->tilesY[level]; y++) {
+        for (int x = 0; x < header->tilesX[level]; x++) {
+            for (int q = 0; q < 4; q++) {
+                int dx = q & 1, dy = q >> 1;
+                if (!readTile(fp, header, level-1, 2*x + dx, 2*y + dy, &child[0]))
+                    return false;
+
+                for (int r = 0; r < half; r++) {
+                    unsigned char *src = &child[3 * (2*r) * T];
+                    unsigned char *dst = &parent[3 * ((dy*half + r) * T + dx*half)];
+                    for (int c = 0; c < 3 * half; c++) {
+                        int k = 6 * (c / 3) + c % 3;
+                        dst[c] = (unsigned char)((src[k] + src[k+3] + src[3*T + k] + src[3*T + k+3] + 2) / 4);
+                    }
+                }
+            }
+            if (fseeko(fp, tileOffset(header, level, x, y), SEEK_SET) != 0 ||
+                fwrite(&parent[0], VT_TILE_BYTES, 1, fp) != 1)
+                return false;
+        }
+    }
+    return true;
+}
+
+/**
+ ** cut a BMP into a tile pack for InitVirtualTexture(): the finest level is the
+ ** image stretched up to a power of two number of tiles each way, and every
+ ** level after it half that, down to a single row or column of tiles
+ **/
+bool BuildVirtualTexture(char *bmpfile, char *packfile) {
+    // GL-ready rows are read straight from the mapped file; anything else is decoded
+    VtSource src;
+    BmpMapping map;
+    unsigned char *decoded = NULL;
+    bool mapped = BmpMap(bmpfile, &map);
+    if (mapped && map.format != 0) {
+        src.rows = map.pixels;
+        src.width = map.width;
+        src.height = map.height;
+        src.rowbytes = map.rowbytes;
+        src.bpp = map.ncomps;
+        src.bgr = true;
+    } else {
+        if (mapped) BmpUnmap(&map);
+        mapped = false;
+        decoded = BmpToImage(bmpfile, &src.width, &src.height, NULL);
+        if (decoded == NULL) {
+            fprintf(stderr, "Cannot read '%s'\n", bmpfile);
+            return false;
+        }
+        src.rows = decoded;
+        src.rowbytes = 3 * (size_t)src.width;
+        src.bpp = 3;
+        src.bgr = false;
+    }
+
+    VtHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "VTEX", 4);
+    header.version = VT_PACK_VERSION;
+    header.width = src.width;
+    header.height = src.height;
+    header.tileSize = VT_TILE_SIZE;
+
+    int tilesX = nextPowerOfTwo((src.width + VT_TILE_SIZE - 1) / VT_TILE_SIZE);
+    int tilesY = nextPowerOfTwo((src.height + VT_TILE_SIZE - 1) / VT_TILE_SIZE);
+    long long offset = sizeof(VtHeader);
+    while (header.numLevels < VT_MAX_LEVELS) {
+        int level = header.numLevels++;
+        header.tilesX[level] = tilesX;
+        header.tilesY[level] = tilesY;
+        header.offset[level] = offset;
+        offset += (long long)tilesX * tilesY * VT_TILE_BYTES;
+        if (tilesX == 1 || tilesY == 1) break;
+        tilesX /= 2;
+        tilesY /= 2;
+    }
+
+    bool ok = false;
+    FILE *fp = fopen(packfile, "w+b");
+    if (fp != NULL) {
+        ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+             writeBaseLevel(fp, &src, header.tilesX[0], header.tilesY[0]);
+        for (int level = 1; ok && level < header.numLevels; level++)
+            ok = writeCoarserLevel(fp, &header, level);
+        ok = (fclose(fp) == 0) && ok;
+    }
+
+    if (mapped) BmpUnmap(&map);
+    delete [] decoded;
+
+    if (!ok) {
+        fprintf(stderr, "Cannot write tile pack '%s'\n", packfile);
+        remove(packfile);
+        return false;
+    }
+
+    fprintf(stderr, "%s: %d x %d in %d levels of %d px tiles (%d x %d at the finest), %lld MB\n",
+            packfile, src.width, src.height, header.numLevels, VT_TILE_SIZE,
+            header.tilesX[0], header.tilesY[0], offset >> 20);
+    return true;
+}
+
+
+// MARK: - Streaming
+
+VtTile* vtTile(int level, int x, int y) {
+    return &vtTiles[level][(size_t)y * vtHeader.tilesX[level] + x];
+}
+
+void tileReader() {
+    traceThreadName("Tile reader");
+    for (;;) {
+        VtRead read;
+        {
+            std::unique_lock<std::mutex> lock(vtLock);
+            while (!stopReader && vtRequests.empty())
+                vtWaiting.wait(lock);
+            if (stopReader) return;
+            read = vtRequests.front();
+            vtRequests.pop_front();
+        }
+        TRACE_ZONE("Read tile");
+
+        read.pixels = new unsigned char[VT_TILE_BYTES];
+        if (!readTile(vtFile, &vtHeader, read.level, read.x, read.y, read.pixels)) {
+            delete [] read.pixels;
+            read.pixels = NULL;
+        }
+
+        std::lock_guard<std::mutex> lock(vtLock);
+        vtDone.push_back(read);
+    }
+}
+
+void cleanVirtualTexture() {
+    puts("Cleaning virtual texture resources");
+
+    {
+        std::lock_guard<std::mutex> lock(vtLock);
+        stopReader = true;
+    }
+    vtWaiting.notify_all();
+    if (vtReader.joinable())
+        vtReader.join();
+
+    for (size_t i = 0; i < vtDone.size(); i++)
+        delete [] vtDone[i].pixels;
+    vtDone.clear();
+    vtRequests.clear();
+
+    if (vtFile != NULL) fclose(vtFile);
+    vtFile = NULL;
+    if (vtCache != 0) glDeleteTextures(1, &vtCache);
+    vtCache = 0;
+    vtReady = false;
+}
+
+// a slot for a new tile: a free one, else the least recently drawn one not drawn last frame (-1 if none):
+int claimSlot() {
+    int victim = -1;
+    for (int i = 0; i < VT_NUM_SLOTS; i++) {
+        VtSlot *s = &vtSlots[i];
+        if (s->pinned) continue;
+        if (s->level < 0) return i;
+        if (vtFrame - s->lastUsed < 2) continue;
+        if (victim < 0 || s->lastUsed < vtSlots[victim].lastUsed)
+            victim = i;
+    }
+
+    if (victim >= 0) {
+        VtSlot *s = &vtSlots[victim];
+        vtTile(s->level, s->x, s->y)->slot = -1;
+        s->level = -1;
+    }
+    return victim;
+}
+
+void uploadTile(int slot, int level, int x, int y, unsigned char *pixels) {
+    glBindTexture(GL_TEXTURE_2D, vtCache);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, (slot % VT_CACHE_SLOTS) * VT_TILE_SIZE, (slot / VT_CACHE_SLOTS) * VT_TILE_SIZE,
+                    VT_TILE_SIZE, VT_TILE_SIZE, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+
+    VtSlot *s = &vtSlots[slot];
+    s->level = level;
+    s->x = x;
+    s->y = y;
+    s->lastUsed = vtFrame;
+    vtTile(level, x, y)->slot = (short)slot;
+}
+
+/**
+ ** open a tile pack, make the cache texture and read in the coarsest level
+ ** (call with the GL context current); false if packfile is not a usable pack
+ **/
+bool InitVirtualTexture(char *packfile) {
+    vtFile = fopen(packfile, "rb");
+    if (vtFile == NULL)
+        return false;
+
+    VtHeader *h = &vtHeader;
+    bool ok = fread(h, sizeof(VtHeader), 1, vtFile) == 1 && memcmp(h->magic, "VTEX", 4) == 0 &&
+              h->version == VT_PACK_VERSION && h->tileSize == VT_TILE_SIZE &&
+              h->numLevels >= 1 && h->numLevels <= VT_MAX_LEVELS;
+    for (int level = 0; ok && level < h->numLevels; level++)
+        ok = h->tilesX[level] >= 1 && h->tilesY[level] >= 1 &&
+             (level == 0 || (h->tilesX[level] * 2 == h->tilesX[level-1] && h->tilesY[level] * 2 == h->tilesY[level-1]));
+
+    int top = h->numLevels - 1;
+    if (ok && h->tilesX[top] * h->tilesY[top] > VT_NUM_SLOTS / 4) {
+        fprintf(stderr, "Tile pack '%s' has too many tiles at its coarsest level\n", packfile);
+        ok = false;
+    } else if (!ok) {
+        fprintf(stderr, "'%s' is not a tile pack\n", packfile);
+    }
+    if (!ok) {
+        fclose(vtFile);
+        vtFile = NULL;
+        return false;
+    }
+
+    for (int level = 0; level < h->numLevels; level++) {
+        VtTile empty = { -1, false };
+        vtTiles[level].assign((size_t)h->tilesX[level] * h->tilesY[level], empty);
+    }
+    for (int i = 0; i < VT_NUM_SLOTS; i++) {
+        vtSlots[i].level = -1;
+        vtSlots[i].pinned = false;
+    }
+
+    glGenTextures(1, &vtCache);
+    glBindTexture(GL_TEXTURE_2D, vtCache);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, VT_CACHE_SLOTS * VT_TILE_SIZE, VT_CACHE_SLOTS * VT_TILE_SIZE, 0,
+                 GL_RGB, GL_UNSIGNED_BYTE, NULL);
+
+    // the coarsest level is always there to fall back on
+    unsigned char *pixels = new unsigned char[VT_TILE_BYTES];
+    int slot = 0;
+    for (int y = 0; y < h->tilesY[top]; y++) {
+        for (int x = 0; x < h->tilesX[top]; x++) {
+            if (!readTile(vtFile, h, top, x, y, pixels))
+                memset(pixels, 128, VT_TILE_BYTES);
+            uploadTile(slot, top, x, y, pixels);
+            vtSlots[slot++].pinned = true;
+        }
+    }
+    delete [] pixels;
+
+    stopReader = false;
+    vtReader = std::thread(tileReader);
+    atexit(cleanVirtualTexture);
+    vtReady = true;
+
+    if (DebugOn)
+        fprintf(stderr, "Virtual texture '%s': %d x %d, %d levels\n", packfile, h->width, h->height, h->numLevels);
+    return true;
+}
+
+// once per frame: move a few of the tiles read since last time into the cache
+void UpdateVirtualTexture() {
+    if (!vtReady) return;
+
+    VtRead done[VT_UPLOADS_PER_FRAME];
+    int numDone = 0;
+    {
+        std::lock_guard<std::mutex> lock(vtLock);
+        while (numDone < VT_UPLOADS_PER_FRAME && !vtDone.empty()) {
+            done[numDone++] = vtDone.front();
+            vtDone.pop_front();
+        }
+    }
+
+    for (int i = 0; i < numDone; i++) {
+        VtRead *read = &done[i];
+        VtTile *tile = vtTile(read->level, read->x, read->y);
+        tile->requested = false;
+        if (read->pixels != NULL && tile->slot < 0) {
+            int slot = claimSlot();
+            if (slot >= 0)
+                uploadTile(slot, read->level, read->x, read->y, read->pixels);
+        }
+        delete [] read->pixels;
+    }
+
+    vtFrame++;
+}
+
+int ResidentTiles() {
+    int resident = 0;
+    for (int i = 0; vtReady && i < VT_NUM_SLOTS; i++)
+        if (vtSlots[i].level >= 0)
+            resident++;
+    return resident;
+}
+
+
+// MARK: - Drawing
+
+// unit normal of the sphere at texture coordinates (s, t) (as MjbSphere lays them out):
+vec3 sphereNormal(float s, float t) {
+    float lat = -M_PI/2.  +  M_PI * t;
+    float lng = -M_PI  +  2. * M_PI * s;
+    return vec3(cosf(lat) * cosf(lng), sinf(lat), -cosf(lat) * sinf(lng));
+}
+
+/**
+ ** how squarely a tile faces the eye (the best of a 3 x 3 grid of points on it),
+ ** or -2 if it is round the back or entirely off screen; a little slack lets
+ ** in tiles just over the horizon or just outside, which the bulge may bring into view
+ ** (from inside the sphere only the screen edges count)
+ **/
+float tileFacing(int level, int x, int y, float rad, bool inside, const mat4 &mv, const mat4 &proj) {
+    bool ortho = proj.c[3].w != 0.;
+    float best = -2.;
+    int allOutside = 0xf;
+
+    for (int j = 0; j <= 2; j++) {
+        for (int i = 0; i <= 2; i++) {
+            vec3 n = sphereNormal((x + i/2.f) / vtHeader.tilesX[level], (y + j/2.f) / vtHeader.tilesY[level]);
+            vec3 ne = transformVector(mv, n);
+            vec3 e = rad * ne + mv.c[3].xyz();
+
+            // cosine between the normal and the way back to the eye
+            float facing = ortho ? ne.z / length(ne) : -dot(ne, e) / (length(ne) * length(e));
+            best = std::max(best, facing);
+
+            vec4 clip = proj * vec4(e, 1.);
+            float cw = 1.1f * clip.w;
+            int outside = 0;
+            if (cw > 0.) {
+                if (clip.x < -cw) outside |= 1;
+                if (clip.x >  cw) outside |= 2;
+                if (clip.y < -cw) outside |= 4;
+                if (clip.y >  cw) outside |= 8;
+            }
+            allOutside &= outside;
+        }
+    }
+
+    if ((best < -0.2 && !inside) || allOutside != 0)
+        return -2.;
+    return best;
+}
+
+/**
+ ** one tile's patch of the sphere, textured from a cache slot: (u0, v0) and size
+ ** place the patch within the tile in the slot (all 0..1), which is the patch's
+ ** own tile or one of its ancestors
+ **/
+void drawPatch(int level, int x, int y, int slot, float u0, float v0, float size, int stepsS, int stepsT,
+               float rad, int slices, int stacks, float* upper, float* lower) {
+    const float C = VT_CACHE_SLOTS * VT_TILE_SIZE;
+    // texel centres only, so linear filtering never reads the next slot over
+    float sx = (slot % VT_CACHE_SLOTS) * VT_TILE_SIZE + 0.5;
+    float sy = (slot / VT_CACHE_SLOTS) * VT_TILE_SIZE + 0.5;
+    float span = VT_TILE_SIZE - 1;
+
+    std::vector<float> pts((size_t)(stepsS + 1) * (stepsT + 1) * 8);
+    for (int j = 0; j <= stepsT; j++) {
+        for (int i = 0; i <= stepsS; i++) {
+            float fu = (float)i / stepsS, fv = (float)j / stepsT;
+            float s = (x + fu) / vtHeader.tilesX[level];
+            float t = (y + fv) / vtHeader.tilesY[level];
+            float *p = &pts[8 * (j * (stepsS + 1) + i)];
+            vec3 n = sphereNormal(s, t);
+            vec3 v = MjbSphereRadius(rad, slices, stacks, upper, lower, s, t) * n;
+            p[0] = v.x;  p[1] = v.y;  p[2] = v.z;
+            p[3] = n.x;  p[4] = n.y;  p[5] = n.z;
+            p[6] = (sx + (u0 + fu * size) * span) / C;
+            p[7] = (sy + (v0 + fv * size) * span) / C;
+        }
+    }
+
+    glBegin(GL_QUADS);
+    for (int j = 0; j < stepsT; j++) {
+        for (int i = 0; i < stepsS; i++) {
+            int corners[4] = { j*(stepsS+1) + i, j*(stepsS+1) + i+1, (j+1)*(stepsS+1) + i+1, (j+1)*(stepsS+1) + i };
+            for (int c = 0; c < 4; c++) {
+                float *p = &pts[8 * corners[c]];
+                glNormal3f(p[3], p[4], p[5]);
+                glTexCoord2f(p[6], p[7]);
+                glVertex3f(p[0], p[1], p[2]);
+            }
+        }
+    }
+    glEnd();
+    profileCount(COUNT_DRAW_CALLS, 1);
+    profileCount(COUNT_SPHERE_VERTICES, 4 * stepsS * stepsT);
+}
+
+/**
+ ** MjbSphere(), textured from the virtual texture: picks the level whose texels
+ ** come closest to one per pixel, draws the tiles of it facing the eye, and asks
+ ** for the ones missing from the cache (plain MjbSphere() if there is no pack)
+ **/
+void DrawVirtualSphere(float rad, int slices, int stacks, float* upper, float* lower) {
+    if (!vtReady) {
+        MjbSphere(rad, slices, stacks, upper, lower);
+        return;
+    }
+
+    mat4 mv, proj;
+    GLint viewport[4];
+    glGetFloatv(GL_MODELVIEW_MATRIX, mv);
+    glGetFloatv(GL_PROJECTION_MATRIX, proj);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    // radius on screen in pixels (the eye inside the sphere wants the finest level)
+    float scale = length(mv.c[0].xyz());
+    float pixels = rad * scale * proj.c[1].y * viewport[3] / 2.;
+    bool inside = false;
+    if (proj.c[3].w == 0.) {
+        float depth = length(mv.c[3].xyz());
+        inside = depth <= rad * scale;
+        pixels = inside ? 1e9 : pixels / depth;
+    }
+
+    // the equator wraps 2 pi r pixels of screen where it is nearest the eye
+    int top = vtHeader.numLevels - 1;
+    int level = top;
+    while (level > 0 && (float)vtHeader.tilesX[level] * VT_TILE_SIZE < 2. * M_PI * pixels)
+        level--;
+
+    // coarser still if the visible tiles would not all fit in the cache
+    int room = VT_NUM_SLOTS - vtHeader.tilesX[top] * vtHeader.tilesY[top] - VT_NUM_SLOTS / 8;
+    std::vector<std::pair<float, int> > visible;
+    for (;; level++) {
+        visible.clear();
+        for (int y = 0; y < vtHeader.tilesY[level]; y++) {
+            for (int x = 0; x < vtHeader.tilesX[level]; x++) {
+                float facing = tileFacing(level, x, y, rad, inside, mv, proj);
+                if (facing > -1.)
+                    visible.push_back(std::make_pair(facing, y * vtHeader.tilesX[level] + x));
+            }
+        }
+        if ((int)visible.size() <= room || level == top) break;
+    }
+    // straight on first, which is also the order they are asked for in
+    std::sort(visible.begin(), visible.end(), std::greater<std::pair<float, int> >());
+
+    // the requests left over from last frame may be out of view now
+    {
+        std::lock_guard<std::mutex> lock(vtLock);
+        for (size_t i = 0; i < vtRequests.size(); i++)
+            vtTile(vtRequests[i].level, vtRequests[i].x, vtRequests[i].y)->requested = false;
+        vtRequests.clear();
+    }
+
+    int stepsS = std::max(2, (slices + vtHeader.tilesX[level] - 1) / vtHeader.tilesX[level]);
+    int stepsT = std::max(2, (stacks + vtHeader.tilesY[level] - 1) / vtHeader.tilesY[level]);
+    std::vector<VtRead> wanted;
+
+    glBindTexture(GL_TEXTURE_2D, vtCache);
+    for (size_t i = 0; i < visible.size(); i++) {
+        int x = visible[i].second % vtHeader.tilesX[level];
+        int y = visible[i].second / vtHeader.tilesX[level];
+
+        VtTile *tile = vtTile(level, x, y);
+        if (tile->slot < 0 && !tile->requested && (int)wanted.size() < VT_MAX_REQUESTS) {
+            VtRead read = { level, x, y, NULL };
+            wanted.push_back(read);
+        }
+
+        // the tile itself, or else the nearest ancestor that is in the cache
+        int a = level, ax = x, ay = y;
+        while (vtTile(a, ax, ay)->slot < 0 && a < top) {
+            a++;
+            ax /= 2;
+            ay /= 2;
+        }
+        int slot = vtTile(a, ax, ay)->slot;
+        vtSlots[slot].lastUsed = vtFrame;
+
+        float size = 1.f / (1 << (a - level));
+        drawPatch(level, x, y, slot, (x - (ax << (a - level))) * size, (y - (ay << (a - level))) * size, size,
+                  stepsS, stepsT, rad, slices, stacks, upper, lower);
+    }
+
+    if (!wanted.empty()) {
+        {
+            std::lock_guard<std::mutex> lock(vtLock);
+            for (size_t i = 0; i < wanted.size(); i++) {
+                vtTile(wanted[i].level, wanted[i].x, wanted[i].y)->requested = true;
+                vtRequests.push_back(wanted[i]);
+            }
+        }
+        vtWaiting.notify_one();
+    }
+}
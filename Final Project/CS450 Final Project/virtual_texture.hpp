@@ -0,0 +1,56 @@
+//
+//  virtual_texture.hpp
+//  CS450 Final Project
+//
+
+#ifndef virtual_texture_hpp
+#define virtual_texture_hpp
+
+#ifdef WIN32
+#include <windows.h>
+#pragma warning(disable:4996)
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <GL/glu.h>
+#include <GL/glut.h>
+#else
+#include <GLUT/glut.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <cmath>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "BmpToTexture.hpp"
+#include "sphere.hpp"
+#include "vecmath.hpp"
+#include "trace.hpp"
+
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+
+// texels along each side of a tile (RGB, no border):
+#define VT_TILE_SIZE        256
+// most levels a tile pack holds (the finest is 2^(VT_MAX_LEVELS-1) times the coarsest):
+#define VT_MAX_LEVELS       12
+// tile slots along each side of the cache texture (16 x 256 = 4096 square, 48 MB of RGB):
+#define VT_CACHE_SLOTS      16
+// tiles copied into the cache each frame, and tiles waiting to be read at once:
+#define VT_UPLOADS_PER_FRAME    8
+#define VT_MAX_REQUESTS         64
+
+#define VT_PACK_VERSION     1
+
+bool BuildVirtualTexture(char *bmpfile, char *packfile);
+
+bool InitVirtualTexture(char *packfile);
+void UpdateVirtualTexture();
+void DrawVirtualSphere(float rad, int slices, int stacks, float* upper, float* lower);
+int ResidentTiles();
+
+#endif /* virtual_texture_hpp */